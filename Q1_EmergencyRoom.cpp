@@ -1,12 +1,29 @@
 // Q1_EmergencyRoom.cpp
 #include <bits/stdc++.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace std;
 using ll = long long;
 
-int now_minutes_since_midnight() {
-    using namespace std::chrono;
-    auto now = system_clock::now();
-    time_t t = system_clock::to_time_t(now);
+// Clock sources for admission/assignment timestamps, in whole minutes.
+// Readings count up from local midnight of the day the clock was created and
+// do not wrap at 1440, so wait times stay correct across midnight.
+class ErClock {
+public:
+    virtual ~ErClock() {}
+    virtual int nowMinutes() = 0;
+};
+
+// minutes from local midnight to `tp` (timezone lookup happens here, once)
+inline int localMinutesOfDay(chrono::system_clock::time_point tp) {
+    time_t t = chrono::system_clock::to_time_t(tp);
     tm local_tm;
 #ifdef _WIN32
     localtime_s(&local_tm, &t);
@@ -16,19 +33,100 @@ int now_minutes_since_midnight() {
     return local_tm.tm_hour * 60 + local_tm.tm_min;
 }
 
+// Wall clock: resolves local midnight once at construction, after that each
+// reading is system_clock arithmetic only (UTC offset is fixed for the run).
+class WallClock : public ErClock {
+private:
+    chrono::system_clock::time_point midnight;
+
+public:
+    WallClock() {
+        auto now = chrono::system_clock::now();
+        auto sinceMidnight = chrono::minutes(localMinutesOfDay(now));
+        midnight = chrono::floor<chrono::minutes>(now) - sinceMidnight;
+    }
+    int nowMinutes() override {
+        auto d = chrono::system_clock::now() - midnight;
+        return (int)chrono::duration_cast<chrono::minutes>(d).count();
+    }
+};
+
+// Monotonic clock: immune to NTP steps and DST jumps; starts at the local
+// time of day when constructed.
+class MonotonicClock : public ErClock {
+private:
+    chrono::steady_clock::time_point start;
+    int startMinutes;
+
+public:
+    MonotonicClock()
+        : start(chrono::steady_clock::now()),
+          startMinutes(localMinutesOfDay(chrono::system_clock::now())) {}
+    int nowMinutes() override {
+        auto d = chrono::steady_clock::now() - start;
+        return startMinutes + (int)chrono::duration_cast<chrono::minutes>(d).count();
+    }
+};
+
+// Coarse cached clock: a ticker thread refreshes the reading from `source`
+// every `period`; nowMinutes() is a single atomic load.
+class CachedClock : public ErClock {
+private:
+    ErClock &source;
+    atomic<int> current;
+    atomic<bool> running{true};
+    thread ticker;
+
+public:
+    explicit CachedClock(ErClock &src, chrono::milliseconds period = chrono::milliseconds(500))
+        : source(src), current(src.nowMinutes()) {
+        ticker = thread([this, period] {
+            while (running.load(memory_order_relaxed)) {
+                this_thread::sleep_for(period);
+                current.store(source.nowMinutes(), memory_order_relaxed);
+            }
+        });
+    }
+    ~CachedClock() {
+        running = false;
+        ticker.join();
+    }
+    int nowMinutes() override { return current.load(memory_order_relaxed); }
+};
+
+// Simulated clock for deterministic tests and replaying recorded days faster
+// than real time; the driver sets or advances it explicitly.
+class SimulatedClock : public ErClock {
+private:
+    atomic<int> current;
+
+public:
+    explicit SimulatedClock(int startMinutes = 0) : current(startMinutes) {}
+    int nowMinutes() override { return current.load(memory_order_relaxed); }
+    void set(int minutes) { current.store(minutes, memory_order_relaxed); }
+    void advance(int minutes) { current.fetch_add(minutes, memory_order_relaxed); }
+};
+
+// process-wide default used when a manager is not given a clock
+inline ErClock &defaultClock() {
+    static WallClock clock;
+    return clock;
+}
+
 struct Patient {
     int patientID;
     string name;
     int severity; // 1=Critical,2=Urgent,3=Standard
     int arrivalTime; // minutes since midnight or any integer time
     int age;
-    int admissionTime; // when admitted into system
+    int admissionTime; // when admitted into system; -1 = stamp on admit
     int assignedTime; // -1 if not assigned
 
-    Patient() {}
+    Patient() : patientID(0), severity(3), arrivalTime(0), age(0),
+                admissionTime(-1), assignedTime(-1) {}
     Patient(int id, string n, int sev, int arr, int a)
         : patientID(id), name(n), severity(sev), arrivalTime(arr), age(a),
-          admissionTime(now_minutes_since_midnight()), assignedTime(-1) {}
+          admissionTime(-1), assignedTime(-1) {}
 };
 
 struct PatientCompare {
@@ -40,84 +138,2441 @@ struct PatientCompare {
     }
 };
 
-class EmergencyRoomManager {
+// 64-bit sort key: severity | biased arrival | inverted age. One integer
+// compare gives the PatientCompare order for severity in [0,255] and age in
+// [0, 2^24); patientID breaks exact ties.
+inline void checkSortSeverity(int severity) {
+    if (severity < 0 || severity > 255) throw runtime_error("Severity out of range.");
+}
+
+inline uint64_t packSortKey(int severity, int arrivalTime, int age) {
+    checkSortSeverity(severity);
+    uint64_t arr = (uint32_t)arrivalTime ^ 0x80000000u;
+    uint64_t inv = 0xFFFFFF - (uint64_t)min(max(age, 0), 0xFFFFFF);
+    return ((uint64_t)severity << 56) | (arr << 24) | inv;
+}
+
+inline uint64_t withSeverity(uint64_t key, int severity) {
+    checkSortSeverity(severity);
+    return (key & ((1ULL << 56) - 1)) | ((uint64_t)severity << 56);
+}
+
+inline int keySeverity(uint64_t key) { return (int)(key >> 56); }
+
+// patientID -> slot map with linear probing and backward-shift deletion, so
+// admit/assign do not allocate or free a node per patient.
+class IdSlotMap {
 private:
-    set<Patient, PatientCompare> pq;
-    unordered_map<int, set<Patient,PatientCompare>::iterator> lookup;
-    vector<Patient> assignedPatients; // history
+    vector<int> keys, vals; // vals[i] == -1 marks an empty cell
+    size_t used = 0;
+    size_t mask = 0;
+
+    static size_t mix(int key) {
+        unsigned long long h = (unsigned int)key * 0x9E3779B97F4A7C15ULL;
+        return (size_t)(h >> 32);
+    }
+
+    void grow() {
+        vector<int> oldK = move(keys), oldV = move(vals);
+        size_t cap = oldK.empty() ? 16 : oldK.size() * 2;
+        keys.assign(cap, 0);
+        vals.assign(cap, -1);
+        mask = cap - 1;
+        used = 0;
+        for (size_t i = 0; i < oldK.size(); ++i)
+            if (oldV[i] != -1) set(oldK[i], oldV[i]);
+    }
 
 public:
-    EmergencyRoomManager() {}
+    void reserve(size_t n) {
+        while (keys.size() < n * 2) grow();
+    }
 
-    void admitPatient(const Patient &patient) {
-        Patient p = patient;
-        // make sure admissionTime is set now if it's default
-        if (p.admissionTime == 0) p.admissionTime = now_minutes_since_midnight();
-        auto it = pq.insert(p);
-        if (it.second) {
-            lookup[p.patientID] = it.first;
+    size_t bytes() const { return keys.capacity() * sizeof(int) * 2; }
+
+    int get(int key) const {
+        if (keys.empty()) return -1;
+        for (size_t i = mix(key) & mask;; i = (i + 1) & mask) {
+            if (vals[i] == -1) return -1;
+            if (keys[i] == key) return vals[i];
+        }
+    }
+
+    void set(int key, int val) {
+        if ((used + 1) * 2 > keys.size()) grow();
+        for (size_t i = mix(key) & mask;; i = (i + 1) & mask) {
+            if (vals[i] == -1) {
+                keys[i] = key;
+                vals[i] = val;
+                used++;
+                return;
+            }
+            if (keys[i] == key) {
+                vals[i] = val;
+                return;
+            }
+        }
+    }
+
+    void erase(int key) {
+        if (keys.empty()) return;
+        size_t i = mix(key) & mask;
+        while (true) {
+            if (vals[i] == -1) return;
+            if (keys[i] == key) break;
+            i = (i + 1) & mask;
+        }
+        // shift later cluster members back into the hole
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (vals[j] == -1) break;
+            size_t home = mix(keys[j]) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                keys[i] = keys[j];
+                vals[i] = vals[j];
+                i = j;
+            }
+        }
+        vals[i] = -1;
+        used--;
+    }
+};
+
+// Interned patient names. Bytes live in fixed 64 KB blocks that never move,
+// and each distinct name is stored once. The dedup index is a flat
+// open-addressing table of name ids, so interning does not allocate per name.
+// Each name counts the rows using it; one nobody uses any more keeps its
+// bytes (and can be revived by the next intern) until the owner rebuilds the
+// arena from its live rows.
+class NameArena {
+private:
+    static const size_t BLOCK = 64 * 1024;
+    vector<unique_ptr<char[]>> blocks;
+    vector<unique_ptr<char[]>> oversized;
+    size_t blockUsed = BLOCK;
+    size_t oversizedBytes = 0;
+    vector<string_view> names;   // name id -> bytes
+    vector<uint32_t> refs;       // name id -> rows using it
+    vector<uint32_t> index;      // name id + 1, 0 = empty cell
+    size_t mask = 0;
+    size_t stored = 0;           // bytes of all names
+    size_t dead = 0;             // of which names with no rows left
+
+    static size_t hashOf(string_view v) { return hash<string_view>()(v); }
+
+    const char *store(string_view s) {
+        if (s.size() > BLOCK / 4) {
+            // oversized name gets an allocation of its own
+            oversized.emplace_back(new char[s.size()]);
+            memcpy(oversized.back().get(), s.data(), s.size());
+            oversizedBytes += s.size();
+            return oversized.back().get();
+        }
+        if (blocks.empty() || blockUsed + s.size() > BLOCK) {
+            blocks.emplace_back(new char[BLOCK]);
+            blockUsed = 0;
+        }
+        char *dst = blocks.back().get() + blockUsed;
+        memcpy(dst, s.data(), s.size());
+        blockUsed += s.size();
+        return dst;
+    }
+
+    void growIndex() {
+        size_t cap = index.empty() ? 1024 : index.size() * 2;
+        index.assign(cap, 0);
+        mask = cap - 1;
+        for (uint32_t id = 0; id < names.size(); ++id) {
+            size_t i = hashOf(names[id]) & mask;
+            while (index[i]) i = (i + 1) & mask;
+            index[i] = id + 1;
+        }
+    }
+
+public:
+    // id of s, stored on first use; adds `uses` rows to its count
+    uint32_t intern(string_view s, uint32_t uses = 1) {
+        if ((names.size() + 1) * 2 > index.size()) growIndex();
+        string_view key(s);
+        size_t i = hashOf(key) & mask;
+        for (; index[i]; i = (i + 1) & mask) {
+            uint32_t id = index[i] - 1;
+            if (names[id] != key) continue;
+            if (refs[id] == 0 && uses) dead -= key.size();
+            refs[id] += uses;
+            return id;
+        }
+        uint32_t id = (uint32_t)names.size();
+        names.push_back(string_view(store(s), s.size()));
+        refs.push_back(uses);
+        stored += s.size();
+        if (!uses) dead += s.size();
+        index[i] = id + 1;
+        return id;
+    }
+
+    // one row stopped using name id
+    void release(uint32_t id) {
+        if (--refs[id] == 0) dead += names[id].size();
+    }
+
+    string_view view(uint32_t id) const { return names[id]; }
+    size_t distinct() const { return names.size(); }
+    size_t nameBytes() const { return stored; }
+    size_t deadBytes() const { return dead; }
+    size_t bytes() const {
+        return blocks.size() * BLOCK + oversizedBytes + names.capacity() * sizeof(string_view) +
+               refs.capacity() * sizeof(uint32_t) + index.capacity() * sizeof(uint32_t);
+    }
+};
+
+// Column views for bulk-loading a queue (e.g. from a snapshot), in priority order
+struct PatientColumns {
+    size_t n = 0;
+    const int32_t *id = nullptr, *severity = nullptr, *arrival = nullptr, *age = nullptr,
+                  *admission = nullptr;
+    const uint32_t *nameId = nullptr; // index into names
+    vector<string_view> names;
+};
+
+// Columnar patient store: one array per field, rows addressed by 32-bit
+// handles, names interned in a NameArena. Freed rows are reused.
+class PatientTable {
+private:
+    vector<int> ids, severities, arrivals, ages, admissions, assigned;
+    vector<uint32_t> nameIds;
+    vector<uint32_t> freeRows;
+    NameArena names;
+    IdSlotMap rowOf; // patientID -> row
+    size_t releasedSinceCompact = 0;
+
+public:
+    void reserve(size_t n) {
+        ids.reserve(n);
+        severities.reserve(n);
+        arrivals.reserve(n);
+        ages.reserve(n);
+        admissions.reserve(n);
+        assigned.reserve(n);
+        nameIds.reserve(n);
+        rowOf.reserve(n);
+    }
+
+    // returns the row handle, or -1 if patientID is already present; an
+    // unset admissionTime (< 0) is stored as `now`
+    int add(const Patient &p, int now = -1) {
+        if (rowOf.get(p.patientID) != -1) return -1;
+        uint32_t nameId = names.intern(p.name);
+        int h;
+        if (!freeRows.empty()) {
+            h = (int)freeRows.back();
+            freeRows.pop_back();
+            ids[h] = p.patientID;
+            severities[h] = p.severity;
+            arrivals[h] = p.arrivalTime;
+            ages[h] = p.age;
+            admissions[h] = p.admissionTime < 0 ? now : p.admissionTime;
+            assigned[h] = p.assignedTime;
+            nameIds[h] = nameId;
         } else {
-            // unlikely: same patientID existing as different ordering key - ensure uniqueness by id externally
+            h = (int)ids.size();
+            ids.push_back(p.patientID);
+            severities.push_back(p.severity);
+            arrivals.push_back(p.arrivalTime);
+            ages.push_back(p.age);
+            admissions.push_back(p.admissionTime < 0 ? now : p.admissionTime);
+            assigned.push_back(p.assignedTime);
+            nameIds.push_back(nameId);
         }
+        rowOf.set(p.patientID, h);
+        return h;
     }
 
-    void updatePatientCondition(int patientID, int newSeverity) {
-        auto itmap = lookup.find(patientID);
-        if (itmap == lookup.end()) {
-            throw runtime_error("Patient not found or already assigned.");
+    void release(int h) {
+        rowOf.erase(ids[h]);
+        freeRows.push_back((uint32_t)h);
+        names.release(nameIds[h]);
+        // Rebuild once dead names outweigh live ones and as many rows have
+        // been released as the table holds since the last rebuild (so the
+        // O(rows) rebuild is amortized O(1) per release)
+        size_t dead = names.deadBytes();
+        if (++releasedSinceCompact >= ids.size() && dead > 64 * 1024 &&
+            dead * 2 > names.nameBytes())
+            compactNames();
+    }
+
+    // Re-interns the names of live rows into a fresh arena, dropping every
+    // name no queued patient uses
+    void compactNames() {
+        releasedSinceCompact = 0;
+        if (names.deadBytes() == 0) return;
+        vector<char> freeRow(ids.size(), 0);
+        for (uint32_t h : freeRows) freeRow[h] = 1;
+        NameArena fresh;
+        for (size_t h = 0; h < ids.size(); ++h)
+            if (!freeRow[h]) nameIds[h] = fresh.intern(names.view(nameIds[h]));
+        names = move(fresh);
+    }
+
+    int find(int patientID) const { return rowOf.get(patientID); }
+    size_t rows() const { return ids.size(); }
+
+    // Bulk load for snapshots: row i gets names[nameId[i]]; handles are
+    // returned in input order. Each distinct name is interned once.
+    void loadRows(const PatientColumns &c, vector<uint32_t> &handles) {
+        vector<uint32_t> uses(c.names.size(), 0), arenaId(c.names.size());
+        for (size_t i = 0; i < c.n; ++i) uses[c.nameId[i]]++;
+        for (size_t i = 0; i < c.names.size(); ++i) arenaId[i] = names.intern(c.names[i], uses[i]);
+        reserve(ids.size() + c.n);
+        handles.resize(c.n);
+        for (size_t i = 0; i < c.n; ++i) {
+            int h = (int)ids.size();
+            ids.push_back(c.id[i]);
+            severities.push_back(c.severity[i]);
+            arrivals.push_back(c.arrival[i]);
+            ages.push_back(c.age[i]);
+            admissions.push_back(c.admission[i]);
+            assigned.push_back(-1);
+            nameIds.push_back(arenaId[c.nameId[i]]);
+            rowOf.set(c.id[i], h);
+            handles[i] = (uint32_t)h;
         }
-        auto it = itmap->second;
-        Patient p = *it;
-        if (p.assignedTime != -1) {
-            throw runtime_error("Patient already assigned to a doctor; cannot update.");
+    }
+
+    int id(int h) const { return ids[h]; }
+    int arrival(int h) const { return arrivals[h]; }
+    int age(int h) const { return ages[h]; }
+    int admission(int h) const { return admissions[h]; }
+    uint32_t nameId(int h) const { return nameIds[h]; }
+    const NameArena &nameArena() const { return names; }
+    int severity(int h) const { return severities[h]; }
+    void setSeverity(int h, int s) { severities[h] = s; }
+    uint64_t sortKey(int h) const { return packSortKey(severities[h], arrivals[h], ages[h]); }
+    string_view name(int h) const { return names.view(nameIds[h]); }
+
+    Patient get(int h) const {
+        Patient p;
+        p.patientID = ids[h];
+        p.name = string(names.view(nameIds[h]));
+        p.severity = severities[h];
+        p.arrivalTime = arrivals[h];
+        p.age = ages[h];
+        p.admissionTime = admissions[h];
+        p.assignedTime = assigned[h];
+        return p;
+    }
+
+    // heap bytes held by the table (columns, names, id index)
+    size_t bytes() const {
+        return ids.capacity() * sizeof(int) * 6 + nameIds.capacity() * sizeof(uint32_t) +
+               freeRows.capacity() * sizeof(uint32_t) + names.bytes() + rowOf.bytes();
+    }
+};
+
+// Heap entries are a packed sort key plus a 32-bit row handle; the patient
+// payload stays in the PatientTable, so sifts move 16 bytes.
+struct HeapEntry {
+    uint64_t key;
+    uint32_t handle;
+    int patientID;
+};
+
+inline bool heapBefore(HeapEntry const &A, HeapEntry const &B) {
+    if (A.key != B.key) return A.key < B.key;
+    return A.patientID < B.patientID;
+}
+
+// Indexed 4-ary min-heap keyed by patientID, same ordering as PatientCompare.
+// Supports decrease-key/increase-key through changeSeverity().
+class IndexedPatientHeap {
+private:
+    static const int D = 4;
+    vector<HeapEntry> heap;
+    PatientTable table;
+    vector<int> slotPos;        // row handle -> position in heap (-1 if free)
+
+    void place(int i, HeapEntry const &e) {
+        heap[i] = e;
+        slotPos[e.handle] = i;
+    }
+
+    void siftUp(int i) {
+        HeapEntry e = heap[i];
+        while (i > 0) {
+            int parent = (i - 1) / D;
+            if (!heapBefore(e, heap[parent])) break;
+            place(i, heap[parent]);
+            i = parent;
         }
-        pq.erase(it);
-        p.severity = newSeverity;
-        auto inserted = pq.insert(p);
-        lookup[patientID] = inserted.first;
+        place(i, e);
     }
 
-    int assignDoctors(int availableDoctors) {
-        int assigned = 0;
-        for (int i = 0; i < availableDoctors; ++i) {
-            if (pq.empty()) break;
-            auto it = pq.begin();
-            Patient p = *it;
-            pq.erase(it);
-            lookup.erase(p.patientID);
-            p.assignedTime = now_minutes_since_midnight();
-            assignedPatients.push_back(p);
-            assigned++;
+    void siftDown(int i) {
+        int n = (int)heap.size();
+        HeapEntry e = heap[i];
+        while (true) {
+            int first = i * D + 1;
+            if (first >= n) break;
+            int last = min(first + D, n);
+            int best = first;
+            for (int c = first + 1; c < last; ++c)
+                if (heapBefore(heap[c], heap[best])) best = c;
+            if (!heapBefore(heap[best], e)) break;
+            place(i, heap[best]);
+            i = best;
         }
-        return assigned;
+        place(i, e);
     }
 
-    double getAverageWaitingTime(int severityLevel) {
-        long long sum = 0;
-        int cnt = 0;
-        for (auto &p : assignedPatients) {
-            if (p.severity == severityLevel && p.assignedTime >= 0) {
-                sum += (p.assignedTime - p.admissionTime);
-                cnt++;
-            }
+    // adds p at the bottom of the heap without restoring heap order
+    bool append(const Patient &p, int now = -1) {
+        uint64_t key = packSortKey(p.severity, p.arrivalTime, p.age);
+        int h = table.add(p, now);
+        if (h == -1) return false;
+        if (h >= (int)slotPos.size()) slotPos.resize(h + 1, -1);
+        heap.push_back({key, (uint32_t)h, p.patientID});
+        slotPos[h] = (int)heap.size() - 1;
+        return true;
+    }
+
+    void heapify() {
+        if (heap.size() < 2) return;
+        for (int i = ((int)heap.size() - 2) / D; i >= 0; --i) siftDown(i);
+    }
+
+    void removeAt(int i) {
+        int h = (int)heap[i].handle;
+        table.release(h);
+        slotPos[h] = -1;
+        HeapEntry last = heap.back();
+        heap.pop_back();
+        int n = (int)heap.size();
+        if (i >= n) return;
+        // walk the hole down to a leaf along the best children, then drop
+        // `last` in and sift it back up (it almost always belongs near the bottom)
+        while (true) {
+            int first = i * D + 1;
+            if (first >= n) break;
+            int last_c = min(first + D, n);
+            int best = first;
+            for (int c = first + 1; c < last_c; ++c)
+                if (heapBefore(heap[c], heap[best])) best = c;
+            place(i, heap[best]);
+            i = best;
         }
-        if (cnt == 0) return 0.0;
-        return double(sum) / cnt;
+        place(i, last);
+        siftUp(i);
     }
 
-    // Helper to show current queue (for debugging/demo)
-    void printQueue() {
-        cout << "Current queue (top first):\n";
-        for (auto &p : pq) {
-            cout << p.patientID << " | " << p.name << " | sev:" << p.severity
-                 << " arr:" << p.arrivalTime << " age:" << p.age << "\n";
+public:
+    bool empty() const { return heap.empty(); }
+    size_t size() const { return heap.size(); }
+
+    void reserve(size_t n) {
+        heap.reserve(n);
+        table.reserve(n);
+        slotPos.reserve(n);
+    }
+
+    // returns false if patientID is already queued
+    bool push(const Patient &p) {
+        if (!append(p)) return false;
+        siftUp((int)heap.size() - 1);
+        return true;
+    }
+
+    // Bulk admit: appends the whole batch, then either sifts each new entry
+    // up or, if the batch is large relative to the heap, rebuilds it with
+    // Floyd's O(n) heapify. Returns how many were admitted (dups skipped);
+    // unset admission times are stamped with `now`, and admitted[i] (if
+    // given) is set for each patient taken. Severities are checked first.
+    int pushBatch(const Patient *ps, size_t m, int now = -1, vector<char> *admitted = nullptr) {
+        for (size_t i = 0; i < m; ++i) checkSortSeverity(ps[i].severity);
+        if (admitted) admitted->assign(m, 0);
+        size_t before = heap.size();
+        for (size_t i = 0; i < m; ++i) {
+            bool added = append(ps[i], now);
+            if (admitted) (*admitted)[i] = added;
+        }
+        size_t added = heap.size() - before;
+        if (added * 16 >= heap.size()) heapify();
+        else for (size_t i = before; i < heap.size(); ++i) siftUp((int)i);
+        return (int)added;
+    }
+
+    Patient top() const { return table.get(heap[0].handle); }
+
+    Patient pop() {
+        Patient p = table.get(heap[0].handle);
+        removeAt(0);
+        return p;
+    }
+
+    bool contains(int patientID) const { return table.find(patientID) != -1; }
+
+    // removes a queued patient wherever it sits; returns false if not queued
+    bool remove(int patientID, Patient &out) {
+        int h = table.find(patientID);
+        if (h == -1) return false;
+        out = table.get(h);
+        removeAt(slotPos[h]);
+        return true;
+    }
+
+    // sift instead of erase+insert; returns false if patientID is not queued
+    bool changeSeverity(int patientID, int newSeverity) {
+        int h = table.find(patientID);
+        if (h == -1) return false;
+        int i = slotPos[h];
+        int old = keySeverity(heap[i].key);
+        heap[i].key = withSeverity(heap[i].key, newSeverity);
+        table.setSeverity(h, newSeverity);
+        if (newSeverity < old) siftUp(i);
+        else if (newSeverity > old) siftDown(i);
+        return true;
+    }
+
+    // Bulk re-triage: small batches sift per patient; large ones rewrite the
+    // keys in place and reorder the heap once. Every severity is checked
+    // before any key changes, so a bad one cannot leave the heap half
+    // rewritten. Returns how many were found.
+    int changeSeverities(const vector<pair<int,int>> &changes) {
+        for (auto &c : changes) checkSortSeverity(c.second);
+        int applied = 0;
+        if (changes.size() * 16 < heap.size()) {
+            for (auto &c : changes) applied += changeSeverity(c.first, c.second);
+            return applied;
+        }
+        for (auto &c : changes) {
+            int h = table.find(c.first);
+            if (h == -1) continue;
+            HeapEntry &e = heap[slotPos[h]];
+            e.key = withSeverity(e.key, c.second);
+            table.setSeverity(h, c.second);
+            applied++;
+        }
+        heapify();
+        return applied;
+    }
+
+    // queued patients in priority order (copies; debugging only)
+    vector<Patient> ordered() const {
+        vector<HeapEntry> tmp = heap;
+        sort(tmp.begin(), tmp.end(), heapBefore);
+        vector<Patient> out;
+        out.reserve(tmp.size());
+        for (auto &e : tmp) out.push_back(table.get(e.handle));
+        return out;
+    }
+
+    size_t bytes() const {
+        return heap.capacity() * sizeof(HeapEntry) + slotPos.capacity() * sizeof(int) + table.bytes();
+    }
+
+    // row handles in priority order, for snapshots
+    vector<uint32_t> orderedHandles() const {
+        vector<HeapEntry> tmp = heap;
+        sort(tmp.begin(), tmp.end(), heapBefore);
+        vector<uint32_t> out(tmp.size());
+        for (size_t i = 0; i < tmp.size(); ++i) out[i] = tmp[i].handle;
+        return out;
+    }
+    const PatientTable &rows() const { return table; }
+    void compactNames() { table.compactNames(); }
+
+    // Load an empty heap from rows in priority order; a sorted array is
+    // already a valid heap, so no sifting is needed.
+    void loadOrdered(const PatientColumns &c) {
+        vector<uint32_t> handles;
+        table.loadRows(c, handles);
+        slotPos.assign(table.rows(), -1);
+        heap.reserve(heap.size() + c.n);
+        for (size_t i = 0; i < c.n; ++i) {
+            int h = (int)handles[i];
+            heap.push_back({table.sortKey(h), (uint32_t)h, c.id[i]});
+            slotPos[h] = (int)heap.size() - 1;
         }
+        if (!is_sorted(heap.begin(), heap.end(), heapBefore)) heapify();
     }
 };
 
-// Sample usage / test
-int main() {
-    EmergencyRoomManager mgr;
+// Bucket queue exploiting severity in {1,2,3}: one arrival-ordered run per
+// severity, age/ID tie-break kept inside each bucket. In-order arrivals append
+// to the run in O(1); anything that lands behind the run's tail (late arrival
+// or re-triaged patient) goes to a small per-bucket side heap. Re-triage leaves
+// a stale entry behind (version stamp) that pop() skips. Same order as
+// PatientCompare.
+class SeverityBucketQueue {
+public:
+    static const int NUM_SEVERITIES = 3;
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t handle;
+        int patientID;
+        unsigned version;
+    };
+
+    static bool entryBefore(Entry const &A, Entry const &B) {
+        if (A.key != B.key) return A.key < B.key;
+        return A.patientID < B.patientID;
+    }
+    struct EntryAfter {
+        bool operator()(Entry const &A, Entry const &B) const { return entryBefore(B, A); }
+    };
+
+    struct Bucket {
+        deque<Entry> run;                                        // sorted, append-only
+        priority_queue<Entry, vector<Entry>, EntryAfter> side;   // out-of-order entries
+        int stale = 0;
+    };
+
+    Bucket buckets[NUM_SEVERITIES];
+    PatientTable table;
+    vector<unsigned> slotVersion; // bumped on every re-triage and removal
+    size_t live = 0;
+
+    bool isLive(Entry const &e) const { return slotVersion[e.handle] == e.version; }
+
+    static int bucketOf(int severity) {
+        if (severity < 1 || severity > NUM_SEVERITIES)
+            throw runtime_error("Severity must be 1, 2 or 3 in bucket mode.");
+        return severity - 1;
+    }
+
+    void insertEntry(int b, Entry const &e) {
+        Bucket &q = buckets[b];
+        if (q.run.empty() || !entryBefore(e, q.run.back())) q.run.push_back(e);
+        else q.side.push(e);
+    }
+
+    // drop stale entries so both fronts are live; returns false if bucket is empty
+    bool trimFront(int b) {
+        Bucket &q = buckets[b];
+        while (!q.run.empty() && !isLive(q.run.front())) {
+            q.run.pop_front();
+            q.stale--;
+        }
+        while (!q.side.empty() && !isLive(q.side.top())) {
+            q.side.pop();
+            q.stale--;
+        }
+        return !q.run.empty() || !q.side.empty();
+    }
+
+    bool sideFirst(int b) const {
+        const Bucket &q = buckets[b];
+        if (q.side.empty()) return false;
+        return q.run.empty() || entryBefore(q.side.top(), q.run.front());
+    }
+
+    void compact(int b) {
+        Bucket &q = buckets[b];
+        deque<Entry> run;
+        for (auto &e : q.run) if (isLive(e)) run.push_back(e);
+        vector<Entry> side;
+        while (!q.side.empty()) {
+            if (isLive(q.side.top())) side.push_back(q.side.top());
+            q.side.pop();
+        }
+        q.run.swap(run);
+        q.side = priority_queue<Entry, vector<Entry>, EntryAfter>(EntryAfter(), move(side));
+        q.stale = 0;
+    }
+
+    int frontBucket() {
+        for (int b = 0; b < NUM_SEVERITIES; ++b)
+            if (trimFront(b)) return b;
+        return -1;
+    }
+
+    const Entry &frontEntry(int b) const {
+        return sideFirst(b) ? buckets[b].side.top() : buckets[b].run.front();
+    }
+
+public:
+    bool empty() const { return live == 0; }
+    size_t size() const { return live; }
+
+    void reserve(size_t n) {
+        table.reserve(n);
+        slotVersion.reserve(n);
+    }
+
+    bool push(const Patient &p) {
+        int b = bucketOf(p.severity);
+        int h = table.add(p);
+        if (h == -1) return false;
+        if (h >= (int)slotVersion.size()) slotVersion.resize(h + 1, 0);
+        insertEntry(b, {table.sortKey(h), (uint32_t)h, p.patientID, slotVersion[h]});
+        live++;
+        return true;
+    }
+
+    // Bulk admit, linear: severities are checked up front, then each patient
+    // is appended straight onto its bucket's run. Entries that land behind
+    // the run's tail are set aside and heapified into the side heap in one
+    // pass when it is empty (pushed one by one otherwise). admitted[i], if
+    // given, is set for each patient taken.
+    int pushBatch(const Patient *ps, size_t m, int now = -1, vector<char> *admitted = nullptr) {
+        for (size_t i = 0; i < m; ++i) bucketOf(ps[i].severity);
+        if (admitted) admitted->assign(m, 0);
+        vector<Entry> late[NUM_SEVERITIES];
+        int added = 0;
+        for (size_t i = 0; i < m; ++i) {
+            int h = table.add(ps[i], now);
+            if (h == -1) continue;
+            if (h >= (int)slotVersion.size()) slotVersion.resize(h + 1, 0);
+            Entry e = {table.sortKey(h), (uint32_t)h, ps[i].patientID, slotVersion[h]};
+            deque<Entry> &run = buckets[ps[i].severity - 1].run;
+            if (run.empty() || !entryBefore(e, run.back())) run.push_back(e);
+            else late[ps[i].severity - 1].push_back(e);
+            if (admitted) (*admitted)[i] = 1;
+            added++;
+        }
+        for (int b = 0; b < NUM_SEVERITIES; ++b) {
+            auto &side = buckets[b].side;
+            if (side.empty()) side = priority_queue<Entry, vector<Entry>, EntryAfter>(EntryAfter(), move(late[b]));
+            else for (auto &e : late[b]) side.push(e);
+        }
+        live += added;
+        return added;
+    }
+
+    // severities are checked before any patient moves
+    int changeSeverities(const vector<pair<int,int>> &changes) {
+        for (auto &c : changes) bucketOf(c.second);
+        int applied = 0;
+        for (auto &c : changes) applied += changeSeverity(c.first, c.second);
+        return applied;
+    }
+
+    Patient top() { return table.get(frontEntry(frontBucket()).handle); }
+
+    Patient pop() {
+        int b = frontBucket();
+        int h = (int)frontEntry(b).handle;
+        if (sideFirst(b)) buckets[b].side.pop();
+        else buckets[b].run.pop_front();
+        Patient p = table.get(h);
+        table.release(h);
+        slotVersion[h]++;
+        live--;
+        return p;
+    }
+
+    bool contains(int patientID) const { return table.find(patientID) != -1; }
+
+    // removes a queued patient wherever it sits (its entry goes stale)
+    bool remove(int patientID, Patient &out) {
+        int h = table.find(patientID);
+        if (h == -1) return false;
+        out = table.get(h);
+        buckets[bucketOf(out.severity)].stale++;
+        table.release(h);
+        slotVersion[h]++;
+        live--;
+        return true;
+    }
+
+    bool changeSeverity(int patientID, int newSeverity) {
+        int h = table.find(patientID);
+        if (h == -1) return false;
+        int from = bucketOf(table.severity(h)), to = bucketOf(newSeverity);
+        if (from == to) return true;
+        table.setSeverity(h, newSeverity);
+        slotVersion[h]++;
+        Bucket &old = buckets[from];
+        old.stale++;
+        insertEntry(to, {table.sortKey(h), (uint32_t)h, patientID, slotVersion[h]});
+        if (old.stale > 64 && old.stale * 2 > (int)(old.run.size() + old.side.size())) compact(from);
+        return true;
+    }
+
+    vector<Patient> ordered() const {
+        vector<Patient> out;
+        out.reserve(live);
+        for (int b = 0; b < NUM_SEVERITIES; ++b) {
+            vector<Entry> all(buckets[b].run.begin(), buckets[b].run.end());
+            auto side = buckets[b].side;
+            for (; !side.empty(); side.pop()) all.push_back(side.top());
+            sort(all.begin(), all.end(), entryBefore);
+            for (auto &e : all)
+                if (isLive(e)) out.push_back(table.get(e.handle));
+        }
+        return out;
+    }
+
+    vector<uint32_t> orderedHandles() const {
+        vector<uint32_t> out;
+        out.reserve(live);
+        for (int b = 0; b < NUM_SEVERITIES; ++b) {
+            vector<Entry> all(buckets[b].run.begin(), buckets[b].run.end());
+            auto side = buckets[b].side;
+            for (; !side.empty(); side.pop()) all.push_back(side.top());
+            sort(all.begin(), all.end(), entryBefore);
+            for (auto &e : all)
+                if (isLive(e)) out.push_back(e.handle);
+        }
+        return out;
+    }
+    const PatientTable &rows() const { return table; }
+    void compactNames() { table.compactNames(); }
+
+    // rows in priority order append straight onto each bucket's run
+    void loadOrdered(const PatientColumns &c) {
+        vector<uint32_t> handles;
+        table.loadRows(c, handles);
+        slotVersion.resize(table.rows(), 0);
+        for (size_t i = 0; i < c.n; ++i) {
+            int h = (int)handles[i];
+            insertEntry(bucketOf(c.severity[i]), {table.sortKey(h), (uint32_t)h, c.id[i], slotVersion[h]});
+        }
+        live += c.n;
+    }
+};
+
+// Mergeable quantile sketch for wait times (log-spaced buckets, ~1% relative
+// error, in the style of DDSketch). Zero waits get their own counter.
+class WaitSketch {
+public:
+    static constexpr double GAMMA = 1.02;
+    static const int NUM_BUCKETS = 1024; // covers waits up to GAMMA^1024 (~6e8)
+
+private:
+    long long zeroCount = 0;
+    long long total = 0;
+    long long counts[NUM_BUCKETS] = {};
+
+    static int bucketOf(long long w) {
+        int i = (int)ceil(log((double)w) / log(GAMMA));
+        return min(max(i, 0), NUM_BUCKETS - 1);
+    }
+
+public:
+    void add(long long w) {
+        total++;
+        if (w <= 0) zeroCount++;
+        else counts[bucketOf(w)]++;
+    }
+
+    void merge(const WaitSketch &o) {
+        zeroCount += o.zeroCount;
+        total += o.total;
+        for (int i = 0; i < NUM_BUCKETS; ++i) counts[i] += o.counts[i];
+    }
+
+    long long count() const { return total; }
+
+    // q in [0,1]; bounded scan over a fixed number of buckets
+    double quantile(double q) const {
+        if (total == 0) return 0.0;
+        long long rank = (long long)(q * (total - 1));
+        if (rank < zeroCount) return 0.0;
+        long long seen = zeroCount;
+        for (int i = 0; i < NUM_BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen > rank) return 2.0 * pow(GAMMA, i) / (GAMMA + 1.0);
+        }
+        return 2.0 * pow(GAMMA, NUM_BUCKETS - 1) / (GAMMA + 1.0);
+    }
+};
+
+// Running wait-time aggregates for one severity level
+struct WaitStats {
+    long long count = 0;
+    long long sum = 0;
+    long long minWait = LLONG_MAX;
+    long long maxWait = LLONG_MIN;
+    WaitSketch sketch;
+
+    void add(long long w) {
+        count++;
+        sum += w;
+        minWait = min(minWait, w);
+        maxWait = max(maxWait, w);
+        sketch.add(w);
+    }
+
+    void merge(const WaitStats &o) {
+        count += o.count;
+        sum += o.sum;
+        minWait = min(minWait, o.minWait);
+        maxWait = max(maxWait, o.maxWait);
+        sketch.merge(o.sketch);
+    }
+
+    double mean() const { return count == 0 ? 0.0 : double(sum) / count; }
+};
+
+// Archive of assigned patients: append-only columnar segments of fixed
+// capacity (allocated once, never reallocated), each with its own name bytes
+// and [min,max] assigned-time bounds. With a retention window, segments that
+// fall entirely out of the window are dropped, or spilled to disk if a spill
+// directory is set; window queries only scan segments overlapping the window.
+class AssignedArchive {
+public:
+    static const int SEGMENT = 4096;
+
+    struct Segment {
+        int count = 0;
+        int minAssigned = INT_MAX, maxAssigned = INT_MIN;
+        vector<int32_t> id, severity, arrival, age, admission, assigned;
+        vector<uint32_t> nameEnd; // name i is nameBytes[nameEnd[i-1], nameEnd[i])
+        string nameBytes;
+
+        Segment() {
+            for (auto *c : {&id, &severity, &arrival, &age, &admission, &assigned}) c->reserve(SEGMENT);
+            nameEnd.reserve(SEGMENT);
+        }
+        bool full() const { return count == SEGMENT; }
+        string_view name(int i) const {
+            uint32_t b = i == 0 ? 0 : nameEnd[i - 1];
+            return string_view(nameBytes).substr(b, nameEnd[i] - b);
+        }
+        Patient get(int i) const {
+            Patient p(id[i], string(name(i)), severity[i], arrival[i], age[i]);
+            p.admissionTime = admission[i];
+            p.assignedTime = assigned[i];
+            return p;
+        }
+    };
+
+private:
+    deque<unique_ptr<Segment>> segments;
+    size_t records = 0;       // in memory
+    size_t expired = 0;       // dropped or spilled
+    int windowMinutes = 0;    // 0 = keep everything in memory
+    string spillDir;          // empty = drop expired segments
+    unsigned spillSeq = 0;
+    bool spillError = false;  // a spill failed and the window was lifted
+
+    // segment file: count, then the six int32 columns, name ends, name bytes.
+    // Files are created exclusively, so a segment already on disk (say from
+    // an earlier run) is skipped over, never overwritten; a short write
+    // removes the partial file.
+    bool spill(const Segment &seg) {
+        string path;
+        FILE *f = nullptr;
+        while (!f) {
+            path = spillDir + "/er_archive_" + to_string(spillSeq++) + ".seg";
+            f = fopen(path.c_str(), "wbx");
+            if (!f && errno != EEXIST) return false;
+        }
+        int32_t n = seg.count;
+        bool ok = fwrite(&n, 4, 1, f) == 1;
+        for (auto *c : {&seg.id, &seg.severity, &seg.arrival, &seg.age, &seg.admission, &seg.assigned})
+            ok = ok && fwrite(c->data(), 4, n, f) == (size_t)n;
+        ok = ok && fwrite(seg.nameEnd.data(), 4, n, f) == (size_t)n;
+        ok = ok && fwrite(seg.nameBytes.data(), 1, seg.nameBytes.size(), f) == seg.nameBytes.size();
+        ok = fclose(f) == 0 && ok;
+        if (!ok) remove(path.c_str());
+        return ok;
+    }
+
+    // Runs from append, after the patient has already left the queue, so a
+    // failed spill must not throw: the segment stays in memory, the window
+    // is lifted and spillFailed() reports it.
+    void expire(int now) {
+        if (windowMinutes <= 0) return;
+        while (segments.size() > 1 && segments.front()->maxAssigned < now - windowMinutes) {
+            if (!spillDir.empty() && !spill(*segments.front())) {
+                spillError = true;
+                windowMinutes = 0;
+                return;
+            }
+            records -= segments.front()->count;
+            expired += segments.front()->count;
+            segments.pop_front();
+        }
+    }
+
+public:
+    void setWindow(int minutes) { windowMinutes = minutes; }
+    // numbering continues after any segments earlier runs left in dir
+    void setSpillDir(const string &dir) {
+        spillDir = dir;
+        spillSeq = 0;
+        error_code ec;
+        for (filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            string name = it->path().filename().string();
+            const string prefix = "er_archive_", suffix = ".seg";
+            if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+                continue;
+            spillSeq = max(spillSeq, (unsigned)strtoul(name.c_str() + prefix.size(), nullptr, 10) + 1);
+        }
+    }
+
+    void append(const Patient &p) {
+        if (segments.empty() || segments.back()->full()) {
+            if (!segments.empty()) expire(p.assignedTime);
+            segments.emplace_back(new Segment());
+        }
+        Segment &seg = *segments.back();
+        seg.id.push_back(p.patientID);
+        seg.severity.push_back(p.severity);
+        seg.arrival.push_back(p.arrivalTime);
+        seg.age.push_back(p.age);
+        seg.admission.push_back(p.admissionTime);
+        seg.assigned.push_back(p.assignedTime);
+        seg.nameBytes += p.name;
+        seg.nameEnd.push_back((uint32_t)seg.nameBytes.size());
+        seg.minAssigned = min(seg.minAssigned, p.assignedTime);
+        seg.maxAssigned = max(seg.maxAssigned, p.assignedTime);
+        seg.count++;
+        records++;
+    }
+
+    void clear() {
+        segments.clear();
+        records = 0;
+    }
+
+    size_t size() const { return records; }
+    size_t expiredCount() const { return expired; }
+    bool spillFailed() const { return spillError; }
+
+    // Waits for one severity among patients assigned in [from, to];
+    // touches only segments whose bounds overlap the range.
+    WaitStats windowStats(int severityLevel, int from, int to) const {
+        WaitStats st;
+        for (auto &sp : segments) {
+            const Segment &seg = *sp;
+            if (seg.maxAssigned < from || seg.minAssigned > to) continue;
+            for (int i = 0; i < seg.count; ++i)
+                if (seg.severity[i] == severityLevel && seg.assigned[i] >= from && seg.assigned[i] <= to)
+                    st.add(seg.assigned[i] - seg.admission[i]);
+        }
+        return st;
+    }
+
+    template<class F>
+    void forEach(F f) const {
+        for (auto &sp : segments)
+            for (int i = 0; i < sp->count; ++i) f(*sp, i);
+    }
+
+    vector<Patient> inMemory() const {
+        vector<Patient> out;
+        out.reserve(records);
+        forEach([&](const Segment &seg, int i) { out.push_back(seg.get(i)); });
+        return out;
+    }
+
+    // Read back a spilled segment file (offline analysis).
+    static bool readSpilled(const string &path, vector<Patient> &out) {
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f) return false;
+        Segment seg;
+        int32_t n = 0;
+        bool ok = fread(&n, 4, 1, f) == 1 && n >= 0 && n <= SEGMENT;
+        for (auto *c : {&seg.id, &seg.severity, &seg.arrival, &seg.age, &seg.admission, &seg.assigned}) {
+            if (!ok) break;
+            c->resize(n);
+            ok = fread(c->data(), 4, n, f) == (size_t)n;
+        }
+        if (ok) {
+            seg.nameEnd.resize(n);
+            ok = fread(seg.nameEnd.data(), 4, n, f) == (size_t)n;
+        }
+        if (ok) {
+            seg.nameBytes.resize(n ? seg.nameEnd[n - 1] : 0);
+            ok = fread(&seg.nameBytes[0], 1, seg.nameBytes.size(), f) == seg.nameBytes.size();
+        }
+        fclose(f);
+        if (!ok) return false;
+        seg.count = n;
+        for (int i = 0; i < n; ++i) out.push_back(seg.get(i));
+        return true;
+    }
+
+    size_t bytes() const {
+        size_t b = 0;
+        for (auto &sp : segments) b += SEGMENT * 7 * 4 + sp->nameBytes.capacity();
+        return b;
+    }
+};
+
+#ifndef _WIN32
+// Append-only write-ahead log of queue events in fixed 64-byte records.
+// Records are buffered and written + fdatasync'ed as a group once
+// `groupRecords` are pending or the oldest pending record is `maxDelayMs`
+// old (group commit); commit() forces it. The delay bound holds on an idle
+// queue too: a flusher thread commits a group whose deadline passes with no
+// further events. A failed write or sync cuts the file back to the last
+// durable byte and keeps the records pending; commit() and the log calls
+// throw, the flusher retries after another delay. Names longer than one record's
+// 32 bytes are carried by NameChunk records placed just before the Admit.
+// The file starts with a header record holding a generation number; a new
+// generation begins whenever a snapshot is taken.
+class ErJournal {
+public:
+    enum RecordType : uint8_t { Header = 0, Admit = 1, Update = 2, Assign = 3, NameChunk = 4 };
+
+    struct Record {
+        uint8_t type;
+        uint8_t nameLen;     // bytes of name[] in use
+        uint16_t reserved;
+        int32_t patientID;
+        int32_t severity;
+        int32_t arrivalTime;
+        int32_t age;
+        int32_t time;        // admission time (Admit) or assigned time (Assign)
+        uint32_t seq;        // generation in the header record
+        uint32_t checksum;
+        char name[32];
+    };
+    static_assert(sizeof(Record) == 64, "WAL records are fixed size");
+
+    static uint32_t checksumOf(Record r) {
+        r.checksum = 0;
+        const unsigned char *b = (const unsigned char *)&r;
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < sizeof(Record); ++i) h = (h ^ b[i]) * 16777619u;
+        return h;
+    }
+
+    // Reads every intact record after the header; stops at the first torn
+    // or corrupt one. `validBytes` is where appending may safely resume, or
+    // -1 if the file exists but could not be read (so it must not be reused).
+    static bool readAll(const string &path, uint32_t &generation, vector<Record> &out,
+                        off_t &validBytes) {
+        validBytes = 0;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            if (errno != ENOENT) validBytes = -1;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            validBytes = -1;
+            return false;
+        }
+        // read() may return less than asked, so loop to EOF
+        string bytes((size_t)st.st_size, '\0');
+        size_t got = 0;
+        for (;;) {
+            if (got == bytes.size()) bytes.resize(bytes.size() + 64 * sizeof(Record));
+            ssize_t r = ::read(fd, &bytes[got], bytes.size() - got);
+            if (r == 0) break;
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0) {
+                ::close(fd);
+                validBytes = -1;
+                return false;
+            }
+            got += (size_t)r;
+        }
+        ::close(fd);
+        if (got < sizeof(Record)) return false;
+        vector<Record> recs(got / sizeof(Record));
+        memcpy(recs.data(), bytes.data(), recs.size() * sizeof(Record));
+        if (recs[0].type != Header || checksumOf(recs[0]) != recs[0].checksum) return false;
+        generation = recs[0].seq;
+        size_t n = 1;
+        while (n < recs.size() && recs[n].checksum == checksumOf(recs[n]) && recs[n].type != Header) n++;
+        out.assign(recs.begin() + 1, recs.begin() + n);
+        validBytes = (off_t)(n * sizeof(Record));
+        return true;
+    }
+
+private:
+    int fd = -1;
+    string path;
+    uint32_t generation = 0;
+    vector<Record> pending;
+    size_t groupRecords;
+    chrono::milliseconds maxDelay;
+    chrono::steady_clock::time_point firstPending;
+    off_t written = 0;
+    mutex m;                 // everything above; the flusher shares it
+    condition_variable due;  // first record pending, or stopping
+    bool stopping = false;
+    thread flusher;
+
+    // false if the write or sync failed; the file is then back at `written`
+    // and the records are still pending
+    bool flushLocked() {
+        if (fd < 0 || pending.empty()) return true;
+        size_t bytes = pending.size() * sizeof(Record);
+        if (::write(fd, pending.data(), bytes) != (ssize_t)bytes || fdatasync(fd) != 0) {
+            if (ftruncate(fd, written) != 0 || lseek(fd, written, SEEK_SET) < 0) {
+                // nothing better to do: the next attempt fails the same way
+            }
+            return false;
+        }
+        written += (off_t)bytes;
+        pending.clear();
+        return true;
+    }
+
+    void commitLocked() {
+        if (!flushLocked()) throw runtime_error("WAL write or sync failed.");
+    }
+
+    bool closeLocked() {
+        if (fd < 0) return true;
+        bool ok = flushLocked();
+        ::close(fd);
+        fd = -1;
+        pending.clear();
+        return ok;
+    }
+
+    void push(Record r) {
+        r.checksum = checksumOf(r);
+        if (pending.empty()) {
+            firstPending = chrono::steady_clock::now();
+            due.notify_one();
+        }
+        pending.push_back(r);
+        if (pending.size() >= groupRecords ||
+            chrono::steady_clock::now() - firstPending >= maxDelay)
+            commitLocked();
+    }
+
+    // commits whatever has waited maxDelay; a failed attempt is retried one
+    // delay later
+    void flushLoop() {
+        unique_lock<mutex> lk(m);
+        while (!stopping) {
+            if (pending.empty() || fd < 0) {
+                due.wait(lk);
+            } else if (chrono::steady_clock::now() >= firstPending + maxDelay) {
+                if (!flushLocked()) firstPending = chrono::steady_clock::now();
+            } else {
+                due.wait_until(lk, firstPending + maxDelay);
+            }
+        }
+    }
+
+    static Record blank(RecordType t) {
+        Record r;
+        memset(&r, 0, sizeof(r));
+        r.type = t;
+        return r;
+    }
+
+public:
+    ErJournal(size_t group = 64, int maxDelayMs = 50) : groupRecords(group), maxDelay(maxDelayMs) {
+        flusher = thread([this] { flushLoop(); });
+    }
+    ~ErJournal() {
+        {
+            lock_guard<mutex> lk(m);
+            stopping = true;
+        }
+        due.notify_one();
+        flusher.join();
+        close();
+    }
+
+    // Start a fresh log file (replacing any old one) with the given generation.
+    bool create(const string &p, uint32_t gen) {
+        close();
+        string tmp = p + ".tmp";
+        int f = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (f < 0) return false;
+        Record h = blank(Header);
+        h.seq = gen;
+        h.checksum = checksumOf(h);
+        bool ok = ::write(f, &h, sizeof(h)) == (ssize_t)sizeof(h) && fdatasync(f) == 0;
+        ::close(f);
+        if (!ok || rename(tmp.c_str(), p.c_str()) != 0) return false;
+        return reopen(p, gen, sizeof(Record));
+    }
+
+    // Continue an existing log, cutting off any torn tail at `validBytes`.
+    bool reopen(const string &p, uint32_t gen, off_t validBytes) {
+        lock_guard<mutex> lk(m);
+        closeLocked();
+        fd = ::open(p.c_str(), O_WRONLY);
+        if (fd < 0) return false;
+        if (ftruncate(fd, validBytes) != 0 || lseek(fd, validBytes, SEEK_SET) < 0) {
+            closeLocked();
+            return false;
+        }
+        path = p;
+        generation = gen;
+        written = validBytes;
+        return true;
+    }
+
+    bool isOpen() {
+        lock_guard<mutex> lk(m);
+        return fd >= 0;
+    }
+    uint32_t currentGeneration() {
+        lock_guard<mutex> lk(m);
+        return generation;
+    }
+    const string &filePath() const { return path; } // set only by reopen()
+    // bytes durably in the file (after commit())
+    off_t durableBytes() {
+        lock_guard<mutex> lk(m);
+        return written;
+    }
+
+    void commit() {
+        lock_guard<mutex> lk(m);
+        commitLocked();
+    }
+
+    // false if the last records could not be made durable
+    bool close() {
+        lock_guard<mutex> lk(m);
+        return closeLocked();
+    }
+
+    void logAdmit(const Patient &p) {
+        lock_guard<mutex> lk(m);
+        const string &n = p.name;
+        size_t lastChunk = n.empty() ? 0 : (n.size() - 1) / 32 * 32;
+        for (size_t off = 0; off < lastChunk; off += 32) {
+            Record c = blank(NameChunk);
+            c.patientID = p.patientID;
+            c.nameLen = 32;
+            memcpy(c.name, n.data() + off, 32);
+            push(c);
+        }
+        Record r = blank(Admit);
+        r.patientID = p.patientID;
+        r.severity = p.severity;
+        r.arrivalTime = p.arrivalTime;
+        r.age = p.age;
+        r.time = p.admissionTime;
+        r.nameLen = (uint8_t)(n.size() - lastChunk);
+        memcpy(r.name, n.data() + lastChunk, r.nameLen);
+        push(r);
+    }
+
+    void logUpdate(int patientID, int newSeverity) {
+        lock_guard<mutex> lk(m);
+        Record r = blank(Update);
+        r.patientID = patientID;
+        r.severity = newSeverity;
+        push(r);
+    }
+
+    void logAssign(int patientID, int assignedTime) {
+        lock_guard<mutex> lk(m);
+        Record r = blank(Assign);
+        r.patientID = patientID;
+        r.time = assignedTime;
+        push(r);
+    }
+};
+
+// Snapshot file: this header followed by 8-byte aligned sections, all
+// plain little-endian arrays so the file can be mmap'ed and used in place:
+//   queue:   id, severity, arrival, age, admission, nameId   (int32 x queued)
+//   names:   offsets (uint64 x nameCount+1), bytes
+//   history: id, severity, arrival, age, admission, assigned (int32 x history)
+//            name offsets (uint64 x history+1), bytes
+//   stats:   statsCount x SnapshotStats
+// `checksum` covers the header (with checksum = 0) and every section.
+struct SnapshotHeader {
+    char magic[8];           // "ERSNAP2"
+    uint32_t mode;           // QueueMode at save time
+    uint32_t walGeneration;  // WAL generation this snapshot covers...
+    uint64_t walOffset;      // ...up to this byte offset
+    uint64_t queued;
+    uint64_t nameCount;
+    uint64_t nameBytes;
+    uint64_t history;
+    uint64_t historyNameBytes;
+    uint64_t statsCount;
+    uint64_t checksum;
+};
+
+struct SnapshotStats {
+    int32_t severity;
+    int32_t pad;
+    WaitStats stats;
+};
+static_assert(is_trivially_copyable<WaitStats>::value, "WaitStats is written raw");
+
+inline size_t pad8(size_t n) { return (n + 7) & ~size_t(7); }
+
+// FNV-1a over 64-bit words instead of bytes (a short tail is zero-padded),
+// so checking a large snapshot costs about one multiply per 8 bytes. Bytes
+// may arrive in pieces of any size.
+class SnapshotHash {
+    uint64_t h = 14695981039346656037ull;
+    uint64_t carry = 0;
+    int carried = 0;
+
+    void word(uint64_t w) { h = (h ^ w) * 1099511628211ull; }
+
+public:
+    void add(const void *data, size_t n) {
+        const unsigned char *b = (const unsigned char *)data;
+        for (; n && carried; --n, ++b) {
+            carry |= (uint64_t)*b << (8 * carried);
+            if (++carried == 8) { word(carry); carry = 0; carried = 0; }
+        }
+        for (; n >= 8; n -= 8, b += 8) {
+            uint64_t w;
+            memcpy(&w, b, 8);
+            word(w);
+        }
+        for (; n; --n, ++b) carry |= (uint64_t)*b << (8 * carried++);
+    }
+    uint64_t value() const {
+        SnapshotHash t = *this;
+        if (t.carried) t.word(t.carry);
+        return t.h;
+    }
+};
+#endif
+
+enum class QueueMode { Heap, Bucket };
+
+class EmergencyRoomManager {
+private:
+    QueueMode mode;
+    ErClock *clock;
+    IndexedPatientHeap heapQ;
+    SeverityBucketQueue bucketQ;
+    AssignedArchive assignedPatients; // history (only if retainHistory)
+    bool retainHistory = true;
+    unordered_map<int, WaitStats> waitStats; // severity -> running aggregates
+#ifndef _WIN32
+    unique_ptr<ErJournal> journal; // null unless journaling is enabled
+#endif
+
+    bool queueEmpty() const { return mode == QueueMode::Heap ? heapQ.empty() : bucketQ.empty(); }
+    bool queueContains(int id) const { return mode == QueueMode::Heap ? heapQ.contains(id) : bucketQ.contains(id); }
+    Patient queuePop() { return mode == QueueMode::Heap ? heapQ.pop() : bucketQ.pop(); }
+
+#ifndef _WIN32
+    // Everything is checked (checksum, then every count, offset and index)
+    // before a string_view or patient is built from the mapping; false if
+    // anything is off, with nothing loaded.
+    bool loadSnapshot(const char *base, size_t size, uint32_t &gen, uint64_t &off) {
+        SnapshotHeader h;
+        memcpy(&h, base, sizeof(h));
+        if (memcmp(h.magic, "ERSNAP2", 8) != 0) return false;
+        // each count is bounded by the file size first, so `need` cannot overflow
+        if (h.queued > size / 24 || h.nameCount >= size / 8 || h.nameBytes > size || h.history > size / 32 ||
+            h.historyNameBytes > size || h.statsCount > size / sizeof(SnapshotStats))
+            return false;
+        size_t need = sizeof(h) + 6 * pad8(h.queued * 4) + (h.nameCount + 1) * 8 + pad8(h.nameBytes) +
+                      6 * pad8(h.history * 4) + (h.history + 1) * 8 + pad8(h.historyNameBytes) +
+                      h.statsCount * sizeof(SnapshotStats);
+        if (size < need) return false;
+        SnapshotHeader zeroed = h;
+        zeroed.checksum = 0;
+        SnapshotHash sum;
+        sum.add(&zeroed, sizeof(zeroed));
+        sum.add(base + sizeof(h), need - sizeof(h));
+        if (sum.value() != h.checksum) return false;
+        gen = h.walGeneration;
+        off = h.walOffset;
+
+        const char *cur = base + sizeof(h);
+        auto column = [&](size_t n) {
+            const int32_t *c = (const int32_t *)cur;
+            cur += pad8(n * 4);
+            return c;
+        };
+        PatientColumns cols;
+        cols.n = h.queued;
+        cols.id = column(h.queued);
+        cols.severity = column(h.queued);
+        cols.arrival = column(h.queued);
+        cols.age = column(h.queued);
+        cols.admission = column(h.queued);
+        cols.nameId = (const uint32_t *)column(h.queued);
+        const uint64_t *offs = (const uint64_t *)cur;
+        cur += (h.nameCount + 1) * 8;
+        const char *nameBytes = cur;
+        cur += pad8(h.nameBytes);
+        const int32_t *hid = column(h.history), *hsev = column(h.history), *harr = column(h.history),
+                      *hage = column(h.history), *hadm = column(h.history), *hasg = column(h.history);
+        const uint64_t *hoffs = (const uint64_t *)cur;
+        cur += (h.history + 1) * 8;
+        const char *historyNames = cur;
+        cur += pad8(h.historyNameBytes);
+        const char *stats = cur;
+
+        // offsets must start at 0, never decrease and end at the byte count
+        auto offsetsValid = [](const uint64_t *o, size_t n, uint64_t bytes) {
+            if (o[0] != 0 || o[n] != bytes) return false;
+            for (size_t i = 0; i < n; ++i)
+                if (o[i] > o[i + 1]) return false;
+            return true;
+        };
+        if (!offsetsValid(offs, h.nameCount, h.nameBytes) || !offsetsValid(hoffs, h.history, h.historyNameBytes))
+            return false;
+        int minSev = mode == QueueMode::Heap ? 0 : 1, maxSev = mode == QueueMode::Heap ? 255 : 3;
+        for (size_t i = 0; i < h.queued; ++i)
+            if (cols.nameId[i] >= h.nameCount || cols.severity[i] < minSev || cols.severity[i] > maxSev)
+                return false;
+        for (size_t i = 0; i < h.statsCount; ++i) {
+            int32_t sev;
+            memcpy(&sev, stats + i * sizeof(SnapshotStats), sizeof(sev));
+            if (sev < 0 || sev > 255) return false;
+        }
+
+        cols.names.resize(h.nameCount);
+        for (size_t i = 0; i < h.nameCount; ++i)
+            cols.names[i] = string_view(nameBytes + offs[i], offs[i + 1] - offs[i]);
+        if (mode == QueueMode::Heap) heapQ.loadOrdered(cols);
+        else bucketQ.loadOrdered(cols);
+
+        cur = historyNames;
+        for (size_t i = 0; i < h.history; ++i) {
+            Patient p(hid[i], string(cur + hoffs[i], hoffs[i + 1] - hoffs[i]), hsev[i], harr[i], hage[i]);
+            p.admissionTime = hadm[i];
+            p.assignedTime = hasg[i];
+            assignedPatients.append(p);
+        }
+        cur = stats;
+        for (size_t i = 0; i < h.statsCount; ++i) {
+            SnapshotStats ss;
+            memcpy(&ss, cur, sizeof(ss));
+            cur += sizeof(ss);
+            waitStats[ss.severity] = ss.stats;
+        }
+        return true;
+    }
+
+    // Re-apply logged events without logging them again or reading the clock.
+    void replay(const vector<ErJournal::Record> &recs, size_t from) {
+        string pendingName;
+        for (size_t i = from; i < recs.size(); ++i) {
+            const ErJournal::Record &r = recs[i];
+            if (r.type == ErJournal::NameChunk) {
+                pendingName.append(r.name, r.nameLen);
+            } else if (r.type == ErJournal::Admit) {
+                pendingName.append(r.name, r.nameLen);
+                Patient p(r.patientID, pendingName, r.severity, r.arrivalTime, r.age);
+                p.admissionTime = r.time;
+                if (mode == QueueMode::Heap) heapQ.push(p);
+                else bucketQ.push(p);
+                pendingName.clear();
+            } else if (r.type == ErJournal::Update) {
+                if (mode == QueueMode::Heap) heapQ.changeSeverity(r.patientID, r.severity);
+                else bucketQ.changeSeverity(r.patientID, r.severity);
+            } else if (r.type == ErJournal::Assign) {
+                Patient p;
+                bool found = mode == QueueMode::Heap ? heapQ.remove(r.patientID, p)
+                                                     : bucketQ.remove(r.patientID, p);
+                if (!found) continue;
+                p.assignedTime = r.time;
+                waitStats[p.severity].add(p.assignedTime - p.admissionTime);
+                if (retainHistory) assignedPatients.append(p);
+            }
+        }
+    }
+#endif
+
+public:
+    explicit EmergencyRoomManager(QueueMode m = QueueMode::Heap, ErClock *clk = nullptr)
+        : mode(m), clock(clk ? clk : &defaultClock()) {}
+
+    QueueMode queueMode() const { return mode; }
+
+    void reserve(size_t n) {
+        if (mode == QueueMode::Heap) heapQ.reserve(n);
+        else bucketQ.reserve(n);
+    }
+
+    void admitPatient(const Patient &patient) {
+        Patient p = patient;
+        // make sure admissionTime is set now if it's default
+        if (p.admissionTime < 0) p.admissionTime = clock->nowMinutes();
+        // duplicate patientID is ignored - ensure uniqueness by id externally
+        bool added = mode == QueueMode::Heap ? heapQ.push(p) : bucketQ.push(p);
+#ifndef _WIN32
+        if (added && journal) journal->logAdmit(p);
+#endif
+        (void)added;
+    }
+
+    // Mass-casualty burst: one clock read and one queue rebuild for the
+    // whole batch. Returns the number admitted (duplicate IDs are skipped).
+    int admitPatients(const vector<Patient> &batch) {
+        int now = clock->nowMinutes();
+        // the queues stamp unset admission times as they store the rows
+        vector<char> admitted;
+        vector<char> *track = nullptr;
+#ifndef _WIN32
+        if (journal) track = &admitted;
+#endif
+        int added = mode == QueueMode::Heap ? heapQ.pushBatch(batch.data(), batch.size(), now, track)
+                                            : bucketQ.pushBatch(batch.data(), batch.size(), now, track);
+#ifndef _WIN32
+        // only what was taken is logged, so replay never sees a rejected admit
+        if (journal)
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (!admitted[i]) continue;
+                Patient stamped = batch[i];
+                if (stamped.admissionTime < 0) stamped.admissionTime = now;
+                journal->logAdmit(stamped);
+            }
+#endif
+        return added;
+    }
+
+    // Re-score a group of (patientID, newSeverity) pairs, reordering the queue
+    // once. IDs that are not waiting are skipped; returns how many were updated.
+    int updateConditions(const vector<pair<int,int>> &changes) {
+        int applied = mode == QueueMode::Heap ? heapQ.changeSeverities(changes) : bucketQ.changeSeverities(changes);
+#ifndef _WIN32
+        // logged once applied (a bad severity throws above with nothing
+        // changed); re-triage never dequeues, so queued now = updated
+        if (journal)
+            for (auto &c : changes)
+                if (queueContains(c.first)) journal->logUpdate(c.first, c.second);
+#endif
+        return applied;
+    }
+
+    void updatePatientCondition(int patientID, int newSeverity) {
+        // assigned patients leave the queue, so "not queued" covers both cases
+        if (!queueContains(patientID)) {
+            throw runtime_error("Patient not found or already assigned.");
+        }
+        if (mode == QueueMode::Heap) heapQ.changeSeverity(patientID, newSeverity);
+        else bucketQ.changeSeverity(patientID, newSeverity);
+#ifndef _WIN32
+        if (journal) journal->logUpdate(patientID, newSeverity);
+#endif
+    }
+
+    int assignDoctors(int availableDoctors) {
+        int assigned = 0;
+        for (int i = 0; i < availableDoctors; ++i) {
+            if (queueEmpty()) break;
+            Patient p = queuePop();
+            p.assignedTime = clock->nowMinutes();
+#ifndef _WIN32
+            if (journal) journal->logAssign(p.patientID, p.assignedTime);
+#endif
+            waitStats[p.severity].add(p.assignedTime - p.admissionTime);
+            if (retainHistory) assignedPatients.append(p);
+            assigned++;
+        }
+        return assigned;
+    }
+
+    // O(1): answered from the running aggregates, not the history
+    double getAverageWaitingTime(int severityLevel) {
+        auto it = waitStats.find(severityLevel);
+        return it == waitStats.end() ? 0.0 : it->second.mean();
+    }
+
+    // q in [0,1], e.g. 0.95 for p95
+    double getWaitingTimePercentile(int severityLevel, double q) {
+        auto it = waitStats.find(severityLevel);
+        return it == waitStats.end() ? 0.0 : it->second.sketch.quantile(q);
+    }
+
+    WaitStats getWaitStats(int severityLevel) {
+        auto it = waitStats.find(severityLevel);
+        return it == waitStats.end() ? WaitStats() : it->second;
+    }
+
+    // Stop (or resume) keeping every assigned Patient; stats are unaffected
+    void setRetainHistory(bool keep) {
+        retainHistory = keep;
+        if (!keep) assignedPatients.clear();
+    }
+
+    // Keep only the last `minutes` of history in memory (0 = all); older
+    // segments are dropped, or written to spillDir if one is given. If a
+    // spill fails the window is lifted and historySpillFailed() turns true.
+    void setHistoryWindow(int minutes, const string &spillDir = "") {
+        assignedPatients.setWindow(minutes);
+        assignedPatients.setSpillDir(spillDir);
+    }
+    bool historySpillFailed() const { return assignedPatients.spillFailed(); }
+
+    // Per-severity waits over the last `minutes`, scanning only that window
+    WaitStats recentWaitStats(int severityLevel, int minutes) {
+        int now = clock->nowMinutes();
+        return assignedPatients.windowStats(severityLevel, now - minutes, now);
+    }
+
+    const AssignedArchive &history() const { return assignedPatients; }
+
+    size_t queueSize() const { return mode == QueueMode::Heap ? heapQ.size() : bucketQ.size(); }
+    vector<Patient> queueSnapshot() const { return mode == QueueMode::Heap ? heapQ.ordered() : bucketQ.ordered(); }
+
+#ifndef _WIN32
+    // Start journaling every admit/update/assign to a fresh WAL at walPath.
+    bool enableJournal(const string &walPath, size_t groupRecords = 64, int maxDelayMs = 50) {
+        journal.reset(new ErJournal(groupRecords, maxDelayMs));
+        return journal->create(walPath, 1);
+    }
+
+    // Force pending WAL records to disk (e.g. at the end of a triage round).
+    void commitJournal() {
+        if (journal) journal->commit();
+    }
+
+    // Write the whole state to `path` (via a temp file + rename), then start
+    // a new WAL generation so the log only holds events after the snapshot.
+    bool saveSnapshot(const string &path) {
+        SnapshotHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, "ERSNAP2", 8);
+        h.mode = (uint32_t)mode;
+        if (journal) {
+            journal->commit();
+            h.walGeneration = journal->currentGeneration();
+            h.walOffset = (uint64_t)journal->durableBytes();
+        }
+        // only names of queued patients go into the file
+        if (mode == QueueMode::Heap) heapQ.compactNames();
+        else bucketQ.compactNames();
+        const PatientTable &t = mode == QueueMode::Heap ? heapQ.rows() : bucketQ.rows();
+        vector<uint32_t> order = mode == QueueMode::Heap ? heapQ.orderedHandles() : bucketQ.orderedHandles();
+        const NameArena &names = t.nameArena();
+        h.queued = order.size();
+        h.nameCount = names.distinct();
+        for (size_t i = 0; i < h.nameCount; ++i) h.nameBytes += names.view((uint32_t)i).size();
+        vector<Patient> hist = assignedPatients.inMemory();
+        h.history = hist.size();
+        for (auto &p : hist) h.historyNameBytes += p.name.size();
+        h.statsCount = waitStats.size();
+
+        string tmp = path + ".tmp";
+        FILE *f = fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        static const char zeros[8] = {};
+        SnapshotHash sum;
+        auto put = [&](const void *data, size_t bytes) {
+            if (!bytes) return;
+            fwrite(data, 1, bytes, f);
+            sum.add(data, bytes);
+        };
+        auto padTo8 = [&](size_t bytes) { put(zeros, pad8(bytes) - bytes); };
+        auto column = [&](auto get) {
+            vector<int32_t> col(order.size());
+            for (size_t i = 0; i < order.size(); ++i) col[i] = get((int)order[i]);
+            put(col.data(), col.size() * 4);
+            padTo8(col.size() * 4);
+        };
+        put(&h, sizeof(h));
+        column([&](int r) { return t.id(r); });
+        column([&](int r) { return t.severity(r); });
+        column([&](int r) { return t.arrival(r); });
+        column([&](int r) { return t.age(r); });
+        column([&](int r) { return t.admission(r); });
+        column([&](int r) { return (int32_t)t.nameId(r); });
+        vector<uint64_t> offs(h.nameCount + 1, 0);
+        for (size_t i = 0; i < h.nameCount; ++i) offs[i + 1] = offs[i] + names.view((uint32_t)i).size();
+        put(offs.data(), offs.size() * 8);
+        for (size_t i = 0; i < h.nameCount; ++i) {
+            string_view v = names.view((uint32_t)i);
+            put(v.data(), v.size());
+        }
+        padTo8(h.nameBytes);
+
+        auto histColumn = [&](auto get) {
+            vector<int32_t> col(hist.size());
+            for (size_t i = 0; i < col.size(); ++i) col[i] = get(hist[i]);
+            put(col.data(), col.size() * 4);
+            padTo8(col.size() * 4);
+        };
+        histColumn([](const Patient &p) { return p.patientID; });
+        histColumn([](const Patient &p) { return p.severity; });
+        histColumn([](const Patient &p) { return p.arrivalTime; });
+        histColumn([](const Patient &p) { return p.age; });
+        histColumn([](const Patient &p) { return p.admissionTime; });
+        histColumn([](const Patient &p) { return p.assignedTime; });
+        vector<uint64_t> hoffs(h.history + 1, 0);
+        for (size_t i = 0; i < h.history; ++i) hoffs[i + 1] = hoffs[i] + hist[i].name.size();
+        put(hoffs.data(), hoffs.size() * 8);
+        for (auto &p : hist) put(p.name.data(), p.name.size());
+        padTo8(h.historyNameBytes);
+
+        for (auto &kv : waitStats) {
+            SnapshotStats ss = SnapshotStats();
+            ss.severity = kv.first;
+            ss.pad = 0;
+            ss.stats = kv.second;
+            put(&ss, sizeof(ss));
+        }
+        // the header went out with checksum 0, which is what the sum covers
+        h.checksum = sum.value();
+        bool ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1 && !ferror(f) && fflush(f) == 0 && fsync(fileno(f)) == 0;
+        fclose(f);
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) return false;
+        if (journal) return journal->create(journal->filePath(), h.walGeneration + 1);
+        return true;
+    }
+
+    // Cold start on an empty manager: mmap the snapshot (if present),
+    // bulk-load the queue from its columns, replay the WAL tail, then keep
+    // journaling to walPath. Returns false if the snapshot is unreadable.
+    bool recover(const string &snapshotPath, const string &walPath, size_t groupRecords = 64) {
+        bool haveSnap = false;
+        uint32_t snapGen = 0;
+        uint64_t snapOff = 0;
+        int fd = ::open(snapshotPath.c_str(), O_RDONLY);
+        if (fd < 0 && errno != ENOENT) return false;
+        if (fd >= 0) {
+            struct stat st;
+            bool statOk = fstat(fd, &st) == 0;
+            size_t size = statOk ? (size_t)st.st_size : 0;
+            void *map = size >= sizeof(SnapshotHeader) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                                                       : MAP_FAILED;
+            ::close(fd);
+            if (map == MAP_FAILED) return false;
+            bool ok = loadSnapshot((const char *)map, size, snapGen, snapOff);
+            munmap(map, size);
+            if (!ok) return false;
+            haveSnap = true;
+        }
+
+        uint32_t walGen = 0;
+        vector<ErJournal::Record> recs;
+        off_t validBytes = 0;
+        bool haveWal = ErJournal::readAll(walPath, walGen, recs, validBytes);
+        if (validBytes < 0) return false; // unreadable, not absent: keep it
+        if (haveWal) {
+            size_t from = 0;
+            bool use = true;
+            if (haveSnap && walGen == snapGen) from = (snapOff - sizeof(ErJournal::Record)) / sizeof(ErJournal::Record);
+            else if (haveSnap && walGen != snapGen + 1) use = false; // older log, already in snapshot
+            if (use) replay(recs, min(from, recs.size()));
+            else haveWal = false;
+        }
+
+        journal.reset(new ErJournal(groupRecords));
+        if (haveWal) return journal->reopen(walPath, walGen, validBytes);
+        return journal->create(walPath, snapGen + 1);
+    }
+#endif
+
+    // Helper to show current queue (for debugging/demo)
+    void printQueue() {
+        cout << "Current queue (top first):\n";
+        vector<Patient> q = mode == QueueMode::Heap ? heapQ.ordered() : bucketQ.ordered();
+        for (auto &p : q) {
+            cout << p.patientID << " | " << p.name << " | sev:" << p.severity
+                 << " arr:" << p.arrivalTime << " age:" << p.age << "\n";
+        }
+    }
+};
+
+// Thread-safe variant for several triage desks and doctor stations.
+// The queue is sharded by severity (one heap + mutex per level), so admissions
+// at different severities never contend. Admissions at the same severity do:
+// every admit, re-triage into and pop from a level takes that shard's one
+// mutex, so write throughput stops scaling at about NUM_SEVERITIES busy
+// writers. Splitting a level further would make each pop compare the tops of
+// all its sub-heaps to keep the global order. A striped patientID -> severity
+// directory routes re-triage to the right shard. Lock order is always
+// directory stripe, then shards in ascending severity; assignDoctors only ever
+// holds one shard lock and touches the directory after releasing it, so a
+// patient is popped (handed out) exactly once under its shard lock.
+// Build with -pthread.
+class ConcurrentEmergencyRoom {
+public:
+    static const int NUM_SEVERITIES = 3;
+    static const int NUM_STRIPES = 64;
+
+private:
+    struct Shard {
+        mutex m;
+        IndexedPatientHeap q;
+        atomic<size_t> size{0};
+        WaitStats stats; // waits of patients assigned from this shard
+    };
+    struct Stripe {
+        mutex m;
+        unordered_map<int,int> severityOf; // queued patientID -> severity
+    };
+
+    Shard shards[NUM_SEVERITIES];
+    Stripe stripes[NUM_STRIPES];
+    ErClock *clock; // must be safe to read from several threads
+
+    static int shardOf(int severity) {
+        if (severity < 1 || severity > NUM_SEVERITIES)
+            throw runtime_error("Severity must be 1, 2 or 3.");
+        return severity - 1;
+    }
+    Stripe &stripeOf(int patientID) {
+        return stripes[(unsigned)patientID * 2654435761u % NUM_STRIPES];
+    }
+
+public:
+    explicit ConcurrentEmergencyRoom(ErClock *clk = nullptr) : clock(clk ? clk : &defaultClock()) {}
+
+    // returns false if the patientID is already queued
+    bool admitPatient(const Patient &patient) {
+        Patient p = patient;
+        if (p.admissionTime < 0) p.admissionTime = clock->nowMinutes();
+        Shard &sh = shards[shardOf(p.severity)];
+        Stripe &st = stripeOf(p.patientID);
+        lock_guard<mutex> ls(st.m);
+        if (!st.severityOf.emplace(p.patientID, p.severity).second) return false;
+        lock_guard<mutex> lq(sh.m);
+        sh.q.push(p);
+        sh.size.store(sh.q.size(), memory_order_relaxed);
+        return true;
+    }
+
+    // Linearizes at the moment both shard locks are held: either the patient
+    // is still queued and moves, or it was already handed out and this throws.
+    void updatePatientCondition(int patientID, int newSeverity) {
+        int to = shardOf(newSeverity);
+        Stripe &st = stripeOf(patientID);
+        lock_guard<mutex> ls(st.m);
+        auto it = st.severityOf.find(patientID);
+        if (it == st.severityOf.end())
+            throw runtime_error("Patient not found or already assigned.");
+        int from = shardOf(it->second);
+        if (from == to) return;
+        Shard &a = shards[from], &b = shards[to];
+        scoped_lock lq(a.m, b.m);
+        Patient p;
+        if (!a.q.remove(patientID, p))
+            throw runtime_error("Patient not found or already assigned.");
+        p.severity = newSeverity;
+        b.q.push(p);
+        a.size.store(a.q.size(), memory_order_relaxed);
+        b.size.store(b.q.size(), memory_order_relaxed);
+        it->second = newSeverity;
+    }
+
+    // Safe to call from several doctor stations at once. Assigned patients
+    // are appended to `out` if given.
+    int assignDoctors(int availableDoctors, vector<Patient> *out = nullptr) {
+        int assigned = 0;
+        while (assigned < availableDoctors) {
+            Patient p;
+            bool got = false;
+            for (int s = 0; s < NUM_SEVERITIES && !got; ++s) {
+                Shard &sh = shards[s];
+                if (sh.size.load(memory_order_relaxed) == 0) continue;
+                lock_guard<mutex> lq(sh.m);
+                if (sh.q.empty()) continue;
+                p = sh.q.pop();
+                sh.size.store(sh.q.size(), memory_order_relaxed);
+                p.assignedTime = clock->nowMinutes();
+                sh.stats.add(p.assignedTime - p.admissionTime);
+                got = true;
+            }
+            if (!got) break;
+            {
+                Stripe &st = stripeOf(p.patientID);
+                lock_guard<mutex> ls(st.m);
+                st.severityOf.erase(p.patientID);
+            }
+            if (out) out->push_back(move(p));
+            assigned++;
+        }
+        return assigned;
+    }
+
+    size_t size() {
+        size_t n = 0;
+        for (auto &sh : shards) n += sh.size.load(memory_order_relaxed);
+        return n;
+    }
+
+    WaitStats getWaitStats(int severityLevel) {
+        Shard &sh = shards[shardOf(severityLevel)];
+        lock_guard<mutex> lq(sh.m);
+        return sh.stats;
+    }
+};
+
+// Producers admit disjoint ID ranges, re-triagers shuffle severities, and
+// consumers drain; every patient must be handed out exactly once.
+bool runConcurrentStress(int threads, int perThread) {
+    ConcurrentEmergencyRoom er;
+    int total = threads * perThread;
+    atomic<int> admittedDone{0};
+    atomic<long long> failedAdmits{0};
+    vector<vector<Patient>> got(threads);
+    vector<thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            mt19937 rng(t + 1);
+            Patient base(0, "stress", 1, 0, 0);
+            for (int i = 0; i < perThread; ++i) {
+                Patient p = base;
+                p.patientID = t * perThread + i;
+                p.severity = 1 + (int)(rng() % 3);
+                p.arrivalTime = (int)(rng() % 1440);
+                p.age = (int)(rng() % 100);
+                if (!er.admitPatient(p)) failedAdmits++;
+                // re-triage a random (possibly already assigned) patient
+                int victim = (int)(rng() % (unsigned)max(1, (t + 1) * perThread));
+                try {
+                    er.updatePatientCondition(victim, 1 + (int)(rng() % 3));
+                } catch (const runtime_error &) {
+                    // not admitted yet or already assigned: both fine
+                }
+                if (i % 4 == 3) er.assignDoctors(2, &got[t]);
+            }
+            admittedDone++;
+            while (admittedDone.load() < threads || er.size() > 0)
+                er.assignDoctors(8, &got[t]);
+        });
+    }
+    for (auto &th : pool) th.join();
+
+    vector<int> seen(total, 0);
+    long long handed = 0;
+    for (auto &v : got) {
+        for (auto &p : v) {
+            if (p.patientID < 0 || p.patientID >= total) return false;
+            seen[p.patientID]++;
+            handed++;
+        }
+    }
+    bool ok = failedAdmits == 0 && handed == total;
+    for (int c : seen) ok = ok && c == 1;
+    cout << "Stress " << threads << " threads x " << perThread << " patients: "
+         << handed << " handed out, " << (ok ? "each exactly once" : "FAILED") << "\n";
+    return ok;
+}
+
+// Each thread admits a batch then assigns the same number, mixed with
+// re-triage of its own patients; reports total operations per second.
+void runConcurrentScaling(int opsPerThread) {
+    cout << "Concurrent throughput (" << opsPerThread << " admits per thread)\n";
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        ConcurrentEmergencyRoom er;
+        vector<thread> pool;
+        auto t0 = chrono::steady_clock::now();
+        for (int t = 0; t < threads; ++t) {
+            pool.emplace_back([&, t] {
+                mt19937 rng(t + 7);
+                Patient base(0, "scale", 1, 0, 0);
+                int id = t * opsPerThread;
+                for (int i = 0; i < opsPerThread; i += 16) {
+                    for (int k = 0; k < 16; ++k) {
+                        Patient p = base;
+                        p.patientID = id + i + k;
+                        p.severity = 1 + (int)(rng() % 3);
+                        p.arrivalTime = (int)(rng() % 1440);
+                        p.age = (int)(rng() % 100);
+                        er.admitPatient(p);
+                    }
+                    try {
+                        er.updatePatientCondition(id + i + (int)(rng() % 16), 1 + (int)(rng() % 3));
+                    } catch (const runtime_error &) {}
+                    er.assignDoctors(16);
+                }
+            });
+        }
+        for (auto &th : pool) th.join();
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        double ops = (double)threads * opsPerThread * 2;
+        cout << "  " << setw(2) << threads << " threads: " << fixed << setprecision(2)
+             << ops / sec / 1e6 << " Mops/s\n" << defaultfloat;
+    }
+}
+
+// ----------------------------------------------------------------------
+// Benchmarks (run with --bench [n], --layout [n], --batch [queued burst],
+// --snapshot [n], --archive [n], --stress, --scale [n])
+// ----------------------------------------------------------------------
+
+// The previous queue: red-black tree of full Patients + id -> iterator map.
+struct SetPatientQueue {
+    set<Patient, PatientCompare> pq;
+    unordered_map<int, set<Patient,PatientCompare>::iterator> lookup;
+
+    void push(const Patient &p) {
+        auto it = pq.insert(p);
+        if (it.second) lookup[p.patientID] = it.first;
+    }
+    void changeSeverity(int patientID, int newSeverity) {
+        auto itmap = lookup.find(patientID);
+        if (itmap == lookup.end()) return;
+        Patient p = *itmap->second;
+        pq.erase(itmap->second);
+        p.severity = newSeverity;
+        itmap->second = pq.insert(p).first;
+    }
+    Patient pop() {
+        Patient p = *pq.begin();
+        pq.erase(pq.begin());
+        lookup.erase(p.patientID);
+        return p;
+    }
+};
+
+vector<Patient> makeBenchPatients(int n, unsigned seed) {
+    mt19937 rng(seed);
+    vector<Patient> v;
+    v.reserve(n);
+    Patient base(0, "", 3, 0, 0);
+    for (int i = 0; i < n; ++i) {
+        Patient p = base;
+        p.patientID = i;
+        p.name = "Patient " + to_string(i);
+        p.severity = 1 + (int)(rng() % 3);
+        p.arrivalTime = (int)(rng() % 1440);
+        p.age = (int)(rng() % 100);
+        v.push_back(move(p));
+    }
+    return v;
+}
+
+template<class F>
+double timeMs(F f) {
+    auto t0 = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+void runHeapBenchmark(int n) {
+    vector<Patient> patients = makeBenchPatients(n, 42);
+    mt19937 rng(7);
+    vector<pair<int,int>> updates(n / 10);
+    for (auto &u : updates) u = {(int)(rng() % n), 1 + (int)(rng() % 3)};
+
+    cout << "Queue benchmark, " << n << " patients, " << updates.size() << " re-triages\n";
+    uint64_t checkSet = 0, checkHeap = 0; // wrap on overflow
+    {
+        SetPatientQueue q;
+        double tAdmit = timeMs([&] { for (auto &p : patients) q.push(p); });
+        double tUpd = timeMs([&] { for (auto &u : updates) q.changeSeverity(u.first, u.second); });
+        double tPop = timeMs([&] { for (int i = 0; i < n; ++i) checkSet = checkSet * 31 + q.pop().patientID; });
+        cout << "  set<Patient>     admit " << tAdmit << " ms, update " << tUpd << " ms, drain " << tPop << " ms\n";
+    }
+    {
+        IndexedPatientHeap q;
+        q.reserve(n);
+        double tAdmit = timeMs([&] { for (auto &p : patients) q.push(p); });
+        double tUpd = timeMs([&] { for (auto &u : updates) q.changeSeverity(u.first, u.second); });
+        double tPop = timeMs([&] { for (int i = 0; i < n; ++i) checkHeap = checkHeap * 31 + q.pop().patientID; });
+        cout << "  4-ary heap       admit " << tAdmit << " ms, update " << tUpd << " ms, drain " << tPop << " ms\n";
+    }
+    uint64_t checkBucket = 0;
+    {
+        // arrivals in time order, the way a triage desk admits them
+        vector<Patient> byArrival = patients;
+        stable_sort(byArrival.begin(), byArrival.end(),
+                    [](Patient const &a, Patient const &b) { return a.arrivalTime < b.arrivalTime; });
+        SeverityBucketQueue q;
+        q.reserve(n);
+        double tAdmit = timeMs([&] { for (auto &p : byArrival) q.push(p); });
+        double tUpd = timeMs([&] { for (auto &u : updates) q.changeSeverity(u.first, u.second); });
+        double tPop = timeMs([&] { for (int i = 0; i < n; ++i) checkBucket = checkBucket * 31 + q.pop().patientID; });
+        cout << "  severity buckets admit " << tAdmit << " ms, update " << tUpd << " ms, drain " << tPop << " ms\n";
+    }
+    cout << "  same assignment order: " << (checkSet == checkHeap && checkSet == checkBucket ? "yes" : "NO") << "\n";
+}
+
+// heap bytes currently allocated through malloc (0 if not measurable)
+size_t heapBytesInUse() {
+#ifdef __GLIBC__
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// Realistic names: ~86k distinct full names, most longer than SSO
+string benchName(int i) {
+    static const char *first[] = {"Muhammad", "Fatima", "Ali", "Ayesha", "Hassan", "Zainab",
+                                  "Omar", "Maryam", "Bilal", "Khadija", "Usman", "Sana"};
+    static const char *last[] = {"Khan", "Ahmed", "Malik", "Hussain", "Qureshi", "Siddiqui",
+                                 "Chaudhry", "Sheikh", "Raza", "Iqbal", "Butt", "Mirza"};
+    return string(first[i % 12]) + " " + last[(i / 12) % 12] + " " + last[(i / 144) % 12] + "-" +
+           to_string(i % 50);
+}
+
+// Memory per queued patient and comparison throughput: the old set of full
+// Patients vs the columnar table + packed-key heap.
+void runLayoutBenchmark(int n) {
+    vector<Patient> patients = makeBenchPatients(n, 9);
+    for (int i = 0; i < n; ++i) patients[i].name = benchName(i);
+    cout << "Layout benchmark, " << n << " queued patients\n";
+    {
+        size_t before = heapBytesInUse();
+        SetPatientQueue q;
+        for (auto &p : patients) q.push(p);
+        size_t used = heapBytesInUse() - before;
+        cout << "  set<Patient> + map:   " << (double)used / n << " bytes/patient\n";
+    }
+    {
+        size_t before = heapBytesInUse();
+        IndexedPatientHeap q;
+        for (auto &p : patients) q.push(p);
+        size_t used = heapBytesInUse() - before;
+        cout << "  table + handle heap:  " << (double)used / n << " bytes/patient (self-reported "
+             << (double)q.bytes() / n << ")\n";
+    }
+
+    // comparison throughput: sort by each representation
+    vector<Patient> byPatient = patients;
+    vector<HeapEntry> byKey;
+    byKey.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        const Patient &p = patients[i];
+        byKey.push_back({packSortKey(p.severity, p.arrivalTime, p.age), (uint32_t)i, p.patientID});
+    }
+    long long cmpA = 0, cmpB = 0;
+    double tA = timeMs([&] {
+        sort(byPatient.begin(), byPatient.end(),
+             [&](Patient const &a, Patient const &b) { cmpA++; return PatientCompare()(a, b); });
+    });
+    double tB = timeMs([&] {
+        sort(byKey.begin(), byKey.end(),
+             [&](HeapEntry const &a, HeapEntry const &b) { cmpB++; return heapBefore(a, b); });
+    });
+    bool same = true;
+    for (int i = 0; i < n && same; ++i) same = byPatient[i].patientID == byKey[i].patientID;
+    cout << "  sort by Patient:      " << cmpA / tA / 1e3 << " M comparisons/s\n";
+    cout << "  sort by packed key:   " << cmpB / tB / 1e3 << " M comparisons/s\n";
+    cout << "  same order: " << (same ? "yes" : "NO") << "\n";
+}
+
+// Mass-casualty bursts into a busy queue: per-patient loop vs batch APIs.
+void runBatchBenchmark(int queued, int burst) {
+    cout << "Batch benchmark, " << queued << " queued, bursts of " << burst << "\n";
+    vector<Patient> patients = makeBenchPatients(queued + burst * 20, 11);
+    for (auto &p : patients) p.admissionTime = -1; // force admission stamping
+    mt19937 rng(3);
+    for (QueueMode mode : {QueueMode::Heap, QueueMode::Bucket}) {
+        const char *name = mode == QueueMode::Heap ? "heap  " : "bucket";
+        double tLoop = 0, tBatch = 0, tUpdLoop = 0, tUpdBatch = 0;
+        for (int useBatch = 0; useBatch < 2; ++useBatch) {
+            EmergencyRoomManager mgr(mode);
+            mgr.reserve(patients.size());
+            mgr.admitPatients(vector<Patient>(patients.begin(), patients.begin() + queued));
+            for (int b = 0; b < 20; ++b) {
+                vector<Patient> batch(patients.begin() + queued + b * burst,
+                                      patients.begin() + queued + (b + 1) * burst);
+                vector<pair<int,int>> changes(burst);
+                for (auto &c : changes) c = {(int)(rng() % max(1, queued + b * burst)), 1 + (int)(rng() % 3)};
+                if (useBatch) {
+                    tBatch += timeMs([&] { mgr.admitPatients(batch); });
+                    tUpdBatch += timeMs([&] { mgr.updateConditions(changes); });
+                } else {
+                    tLoop += timeMs([&] { for (auto &p : batch) mgr.admitPatient(p); });
+                    tUpdLoop += timeMs([&] {
+                        for (auto &c : changes) {
+                            try { mgr.updatePatientCondition(c.first, c.second); }
+                            catch (const runtime_error &) {}
+                        }
+                    });
+                }
+            }
+        }
+        cout << "  " << name << " admit: loop " << tLoop << " ms, batch " << tBatch
+             << " ms (" << tLoop / tBatch << "x)\n";
+        cout << "  " << name << " re-triage: loop " << tUpdLoop << " ms, batch " << tUpdBatch
+             << " ms (" << tUpdLoop / tUpdBatch << "x)\n";
+    }
+}
+
+// Replays a synthetic night shift (22:00 -> 02:00) on a simulated clock:
+// a patient every 3 minutes, one doctor freeing up every 4 minutes.
+void runReplay() {
+    SimulatedClock sim(22 * 60);
+    EmergencyRoomManager mgr(QueueMode::Heap, &sim);
+    mt19937 rng(5);
+    int id = 0;
+    for (int minute = 0; minute < 4 * 60; ++minute) {
+        if (minute % 3 == 0) {
+            int sev = 1 + (int)(rng() % 3);
+            mgr.admitPatient(Patient(++id, "replay", sev, sim.nowMinutes(), (int)(rng() % 90)));
+        }
+        if (minute % 4 == 0) mgr.assignDoctors(1);
+        sim.advance(1);
+    }
+    cout << "Replayed 22:00-02:00, " << id << " arrivals\n";
+    for (int sev = 1; sev <= 3; ++sev) {
+        WaitStats st = mgr.getWaitStats(sev);
+        cout << "  severity " << sev << ": " << st.count << " seen, avg wait "
+             << st.mean() << " min, max " << (st.count ? st.maxWait : 0) << " min\n";
+    }
+}
+
+// n assignments spread evenly over a week: the old unbounded vector vs the
+// archive (everything, and a 24h window), plus a last-hour query on each.
+void runArchiveBenchmark(int n) {
+    vector<Patient> patients = makeBenchPatients(n, 23);
+    int span = 7 * 1440;
+    vector<Patient> flat;
+    AssignedArchive all, windowed;
+    windowed.setWindow(1440);
+    double tFlat = timeMs([&] {
+        for (int i = 0; i < n; ++i) {
+            Patient p = patients[i];
+            p.admissionTime = (int)((ll)i * span / n);
+            p.assignedTime = p.admissionTime + (int)(p.severity * 7 + i % 13);
+            flat.push_back(move(p));
+        }
+    });
+    double tArchive = timeMs([&] {
+        for (int i = 0; i < n; ++i) {
+            Patient p = patients[i];
+            p.admissionTime = (int)((ll)i * span / n);
+            p.assignedTime = p.admissionTime + (int)(p.severity * 7 + i % 13);
+            all.append(p);
+            windowed.append(p);
+        }
+    });
+    size_t flatBytes = flat.capacity() * sizeof(Patient);
+    for (auto &p : flat) flatBytes += p.name.capacity() > 15 ? p.name.capacity() + 1 : 0;
+
+    int now = span, from = now - 60;
+    WaitStats a, b;
+    double tScan = timeMs([&] {
+        for (auto &p : flat)
+            if (p.severity == 2 && p.assignedTime >= from && p.assignedTime <= now)
+                a.add(p.assignedTime - p.admissionTime);
+    });
+    double tWindow = timeMs([&] { b = all.windowStats(2, from, now); });
+
+    cout << "Archive benchmark, " << n << " assignments over 7 days\n";
+    cout << "  append: vector " << tFlat << " ms, archive (x2) " << tArchive << " ms\n";
+    cout << "  memory: vector " << flatBytes / 1048576.0 << " MB, archive " << all.bytes() / 1048576.0
+         << " MB, 24h window " << windowed.bytes() / 1048576.0 << " MB (" << windowed.size() << " kept, "
+         << windowed.expiredCount() << " expired)\n";
+    cout << "  last-hour severity 2: full scan " << tScan << " ms, segment window " << tWindow << " ms\n";
+    cout << "  results match: " << (a.count == b.count && a.sum == b.sum ? "yes" : "NO") << "\n";
+}
+
+#ifndef _WIN32
+// Crash-recovery check and timings: build a journaled state, snapshot it,
+// keep going, then cold-start a fresh manager from snapshot + WAL tail.
+void runSnapshotBenchmark(int n) {
+    string dir = filesystem::temp_directory_path().string();
+    string snap = dir + "/er_bench.snap", wal = dir + "/er_bench.wal";
+    vector<Patient> patients = makeBenchPatients(n + 2000, 13);
+    for (int i = 0; i < n + 2000; ++i) {
+        patients[i].name = benchName(i);
+        patients[i].admissionTime = -1;
+    }
+    SimulatedClock sim(8 * 60);
+    mt19937 rng(17);
+
+    EmergencyRoomManager live(QueueMode::Heap, &sim);
+    live.enableJournal(wal);
+    double tAdmit = timeMs([&] {
+        live.admitPatients(vector<Patient>(patients.begin(), patients.begin() + n));
+        live.commitJournal();
+    });
+    for (int i = 0; i < n / 20; ++i) live.updatePatientCondition((int)(rng() % n), 1 + (int)(rng() % 3));
+    sim.advance(30);
+    live.assignDoctors(n / 10);
+    double tSave = timeMs([&] { live.saveSnapshot(snap); });
+
+    // events after the snapshot only live in the WAL
+    for (int i = n; i < n + 2000; ++i) live.admitPatient(patients[i]);
+    for (int i = 0; i < 500; ++i) {
+        try { live.updatePatientCondition((int)(rng() % (n + 2000)), 1 + (int)(rng() % 3)); }
+        catch (const runtime_error &) {}
+    }
+    sim.advance(15);
+    live.assignDoctors(700);
+    live.commitJournal();
+
+    EmergencyRoomManager restored(QueueMode::Heap, &sim);
+    bool ok = false;
+    double tRecover = timeMs([&] { ok = restored.recover(snap, wal); });
+    vector<Patient> a = live.queueSnapshot(), b = restored.queueSnapshot();
+    bool same = ok && a.size() == b.size() && live.history().size() == restored.history().size();
+    for (size_t i = 0; same && i < a.size(); ++i)
+        same = a[i].patientID == b[i].patientID && a[i].severity == b[i].severity && a[i].name == b[i].name;
+    for (int sev = 1; sev <= 3 && same; ++sev)
+        same = live.getWaitStats(sev).count == restored.getWaitStats(sev).count &&
+               live.getWaitStats(sev).sum == restored.getWaitStats(sev).sum;
+
+    cout << "Snapshot benchmark, " << n << " patients\n";
+    cout << "  journaled batch admit: " << tAdmit << " ms\n";
+    cout << "  snapshot save:         " << tSave << " ms (" << a.size() << " queued, "
+         << live.history().size() << " history)\n";
+    cout << "  cold start + replay:   " << tRecover << " ms\n";
+    cout << "  restored state matches: " << (same ? "yes" : "NO") << "\n";
+
+    // a flipped byte anywhere in the file must be refused, not loaded
+    bool refused = true;
+    for (long at : {0L, 40L, (long)sizeof(SnapshotHeader) + 5, (long)filesystem::file_size(snap) - 3}) {
+        FILE *f = fopen(snap.c_str(), "r+b");
+        fseek(f, at, SEEK_SET);
+        int c = fgetc(f);
+        fseek(f, at, SEEK_SET);
+        fputc(c ^ 0x40, f);
+        fclose(f);
+        EmergencyRoomManager bad(QueueMode::Heap, &sim);
+        refused = refused && !bad.recover(snap, dir + "/er_bench_bad.wal");
+        f = fopen(snap.c_str(), "r+b");
+        fseek(f, at, SEEK_SET);
+        fputc(c, f);
+        fclose(f);
+    }
+    remove((dir + "/er_bench_bad.wal").c_str());
+    cout << "  corrupt snapshot refused: " << (refused ? "yes" : "NO") << "\n";
+
+    // group commit vs fsync per record
+    for (size_t group : {(size_t)1, (size_t)64, (size_t)1024}) {
+        EmergencyRoomManager m(QueueMode::Heap, &sim);
+        m.enableJournal(wal, group, 1000);
+        int count = min((int)patients.size(), group == 1 ? 500 : 50000);
+        double t = timeMs([&] {
+            for (int i = 0; i < count; ++i) m.admitPatient(patients[i]);
+            m.commitJournal();
+        });
+        cout << "  WAL group " << setw(4) << group << ": " << count / t * 1000 << " admits/s\n";
+    }
+    remove(snap.c_str());
+    remove(wal.c_str());
+}
+#endif
+
+// Sample usage / test
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runHeapBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--layout") {
+        runLayoutBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--batch") {
+        runBatchBenchmark(argc > 2 ? atoi(argv[2]) : 100000, argc > 3 ? atoi(argv[3]) : 500);
+        runBatchBenchmark(0, 20000);
+        return 0;
+    }
+#ifndef _WIN32
+    if (argc > 1 && string(argv[1]) == "--snapshot") {
+        runSnapshotBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+#endif
+    if (argc > 1 && string(argv[1]) == "--archive") {
+        runArchiveBenchmark(argc > 2 ? atoi(argv[2]) : 2000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--replay") {
+        runReplay();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--stress") {
+        bool ok = true;
+        for (int t : {2, 4, 8, 16}) ok = runConcurrentStress(t, 20000) && ok;
+        return ok ? 0 : 1;
+    }
+    if (argc > 1 && string(argv[1]) == "--scale") {
+        runConcurrentScaling(argc > 2 ? atoi(argv[2]) : 200000);
+        return 0;
+    }
+    // --buckets selects the severity bucket queue instead of the heap
+    bool buckets = argc > 1 && string(argv[1]) == "--buckets";
+    EmergencyRoomManager mgr(buckets ? QueueMode::Bucket : QueueMode::Heap);
     // Simulated arrival times (minutes)
     mgr.admitPatient(Patient(1, "Ali Khan", 2, 500, 30));
     mgr.admitPatient(Patient(2, "Zara Ahmed", 1, 505, 70));
@@ -132,5 +2587,6 @@ int main() {
 
     cout << "Average waiting for severity 1: " << mgr.getAverageWaitingTime(1) << " minutes\n";
     cout << "Average waiting for severity 2: " << mgr.getAverageWaitingTime(2) << " minutes\n";
+    cout << "p95 waiting for severity 2: " << mgr.getWaitingTimePercentile(2, 0.95) << " minutes\n";
     return 0;
 }
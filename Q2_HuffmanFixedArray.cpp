@@ -1,120 +1,1813 @@
 // Q2_HuffmanFixedArray.cpp
 #include <bits/stdc++.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
 using namespace std;
 
-const int MAXSYMS = 256;
-const int MAXNODES = MAXSYMS * 2; // safe
+const int MAXSYMS = 65536; // byte strings use the first 256
 
 struct Node {
-    char ch;
+    int sym;
     long long freq;
     int left, right;
     bool active;
-    Node() : ch(0), freq(0), left(-1), right(-1), active(false) {}
+    Node() : sym(0), freq(0), left(-1), right(-1), active(false) {}
 };
 
-Node nodeArray[MAXNODES];
-string codeTable[256];
-int nodeCount = 0;
+// Byte codes as integers for the packed encoder: the code's bits sit in the
+// low `len` bits of `code`, first bit of the path most significant.
+const int MAXPACKEDLEN = 56; // longest code the 64-bit bit writer/reader can take
+struct BitCodes {
+    uint64_t code[256];
+    uint8_t len[256]; // 0 = symbol not in the table
+    int maxLen;
+};
+
+// Byte histogram. A single freq[256] loop stalls on runs of the same byte:
+// every increment waits for the store of the previous one. Four banks of
+// 32-bit counters, one per byte lane of each 4-byte word, keep four
+// independent chains going; the banks are summed at the end. The loop is
+// unrolled by hand and the next words are loaded before the current ones
+// are counted. Adds into freq.
+void byteHistogram(const uint8_t *p, size_t n, long long freq[256]) {
+    const size_t CHUNK = (size_t)1 << 31; // 32-bit bank counters cannot overflow
+    uint32_t c0[256], c1[256], c2[256], c3[256];
+    while (n > 0) {
+        size_t len = min(n, CHUNK);
+        memset(c0, 0, sizeof(c0));
+        memset(c1, 0, sizeof(c1));
+        memset(c2, 0, sizeof(c2));
+        memset(c3, 0, sizeof(c3));
+        size_t i = 0;
+        if (len >= 32) {
+            uint64_t next;
+            memcpy(&next, p, 8);
+            for (; i + 32 <= len; i += 16) {
+                uint64_t a = next, b;
+                memcpy(&b, p + i + 8, 8);
+                memcpy(&next, p + i + 16, 8);
+                c0[(uint8_t)a]++;
+                c1[(uint8_t)(a >> 8)]++;
+                c2[(uint8_t)(a >> 16)]++;
+                c3[(uint8_t)(a >> 24)]++;
+                c0[(uint8_t)(a >> 32)]++;
+                c1[(uint8_t)(a >> 40)]++;
+                c2[(uint8_t)(a >> 48)]++;
+                c3[a >> 56]++;
+                c0[(uint8_t)b]++;
+                c1[(uint8_t)(b >> 8)]++;
+                c2[(uint8_t)(b >> 16)]++;
+                c3[(uint8_t)(b >> 24)]++;
+                c0[(uint8_t)(b >> 32)]++;
+                c1[(uint8_t)(b >> 40)]++;
+                c2[(uint8_t)(b >> 48)]++;
+                c3[b >> 56]++;
+            }
+        }
+        for (; i < len; ++i) c0[p[i]]++;
+        for (int c = 0; c < 256; ++c) freq[c] += (long long)c0[c] + c1[c] + c2[c] + c3[c];
+        p += len;
+        n -= len;
+    }
+}
+
+// Same, split across threads for large buffers (below 4 MB a thread costs
+// more than it saves)
+void byteHistogramParallel(const uint8_t *p, size_t n, long long freq[256], int threads) {
+    const size_t MIN_PER_THREAD = (size_t)4 << 20;
+    threads = (int)min<size_t>(max(threads, 1), max<size_t>(n / MIN_PER_THREAD, 1));
+    if (threads == 1) {
+        byteHistogram(p, n, freq);
+        return;
+    }
+    vector<array<long long, 256>> part(threads);
+    vector<thread> pool;
+    size_t step = (n + threads - 1) / threads;
+    for (int t = 0; t < threads; ++t) {
+        part[t].fill(0);
+        size_t from = min(n, t * step), to = min(n, from + step);
+        pool.emplace_back([&, t, from, to] { byteHistogram(p + from, to - from, part[t].data()); });
+    }
+    for (auto &th : pool) th.join();
+    for (auto &h : part)
+        for (int c = 0; c < 256; ++c) freq[c] += h[c];
+}
+
+// MSB-first bit writer. Pending bits sit at the top of a 64-bit accumulator;
+// after each code the whole accumulator is stored big-endian and the output
+// pointer advances by the completed bytes only, so there is no per-bit or
+// per-byte branching. Needs 8 bytes of slack past the last byte written.
+struct BitWriter {
+    uint8_t *out;
+    uint64_t acc = 0;
+    int n = 0; // pending bits, < 8 between calls
+
+    explicit BitWriter(uint8_t *dst) : out(dst) {}
+
+    void put(uint64_t code, int len) { // len <= MAXPACKEDLEN
+        if (len == 0) return; // code << 64 is undefined
+        acc |= code << (64 - n - len);
+        n += len;
+        uint64_t be = __builtin_bswap64(acc);
+        memcpy(out, &be, 8);
+        out += n >> 3;
+        acc <<= n & ~7;
+        n &= 7;
+    }
+    // bits still in the accumulator go out as one zero-padded byte
+    void flush() {
+        if (n) *out++ = (uint8_t)(acc >> 56);
+        acc = 0;
+        n = 0;
+    }
+};
+
+// Bytes a caller must provide to encodeBits for n input bytes
+size_t encodeBound(const BitCodes &codes, size_t n) {
+    return (n * (size_t)max(codes.maxLen, 1) + 7) / 8 + 8;
+}
+
+// Packs the codes for in[0..n) into out; returns the number of bits written
+// (the last byte is zero-padded), or -1 if cap is below encodeBound, or a
+// byte of the input has no code or one longer than MAXPACKEDLEN.
+long long encodeBits(const BitCodes &codes, const uint8_t *in, size_t n, uint8_t *out, size_t cap) {
+    if (cap < encodeBound(codes, n)) return -1;
+    if (codes.maxLen > MAXPACKEDLEN) {
+        for (size_t i = 0; i < n; ++i)
+            if (codes.len[in[i]] > MAXPACKEDLEN) return -1;
+    }
+    BitWriter bw(out);
+    size_t i = 0;
+    bool missing = false; // a byte with no code; checked once at the end
+    // two codes per store while both are sure to fit in the accumulator
+    if (codes.maxLen <= 28) {
+        for (; i + 1 < n; i += 2) {
+            uint8_t a = in[i], b = in[i + 1];
+            missing |= (codes.len[a] == 0) | (codes.len[b] == 0);
+            bw.put(codes.code[a] << codes.len[b] | codes.code[b], codes.len[a] + codes.len[b]);
+        }
+    }
+    for (; i < n; ++i) {
+        missing |= codes.len[in[i]] == 0;
+        bw.put(codes.code[in[i]], codes.len[in[i]]);
+    }
+    if (missing) return -1;
+    long long bits = (long long)(bw.out - out) * 8 + bw.n;
+    bw.flush();
+    return bits;
+}
+
+// Decoding tables. The primary table is indexed by the next PRIMARY_BITS
+// bits of the stream; an entry either gives the symbol and how many of those
+// bits its code used, or links to a secondary table for the codes sharing
+// that prefix, indexed by the bits that follow (nesting as deep as needed).
+// Codes up to PRIMARY_BITS long, i.e. nearly all of them, take one lookup.
+struct DecodeTable {
+    static const int PRIMARY_BITS = 11;
+    static const uint32_t LINK = 1u << 31;
+    // symbol entry: sym << 8 | bits used (0 = no code has this prefix)
+    // link entry:   LINK | offset << 8 | index bits of the linked table
+    vector<uint32_t> entries;
+    int maxLen = 0;
+};
 
-int newNode(char c, long long f, int l=-1, int r=-1) {
-    nodeArray[nodeCount].ch = c;
-    nodeArray[nodeCount].freq = f;
-    nodeArray[nodeCount].left = l;
-    nodeArray[nodeCount].right = r;
-    nodeArray[nodeCount].active = true;
-    return nodeCount++;
+struct PendingCode {
+    uint64_t code;
+    int len;
+    int sym;
+};
+
+// Fills a table of 2^bits entries at `offset` for codes whose first `depth`
+// bits have already been consumed; longer codes go to linked tables.
+void fillDecodeTable(DecodeTable &t, size_t offset, int bits, int depth, vector<PendingCode> &codes) {
+    map<uint32_t, vector<PendingCode>> longer; // index -> codes continuing past this table
+    for (const PendingCode &c : codes) {
+        int rest = c.len - depth;
+        uint64_t tail = c.code & ((1ull << rest) - 1);
+        if (rest <= bits) {
+            uint32_t first = (uint32_t)(tail << (bits - rest));
+            for (uint32_t i = 0; i < (1u << (bits - rest)); ++i)
+                t.entries[offset + first + i] = (uint32_t)c.sym << 8 | rest;
+        } else {
+            longer[(uint32_t)(tail >> (rest - bits))].push_back(c);
+        }
+    }
+    for (auto &kv : longer) {
+        int sub = 0;
+        for (const PendingCode &c : kv.second) sub = max(sub, c.len - depth - bits);
+        sub = min(sub, (int)DecodeTable::PRIMARY_BITS);
+        size_t at = t.entries.size();
+        t.entries.resize(at + ((size_t)1 << sub), 0);
+        t.entries[offset + kv.first] = DecodeTable::LINK | (uint32_t)at << 8 | sub;
+        fillDecodeTable(t, at, sub, depth + bits, kv.second);
+    }
+}
+
+// Works for any prefix code, so the tree's codes need not be canonical.
+// Returns false if a code is too long for the bit reader.
+bool buildDecodeTable(const BitCodes &codes, DecodeTable &t) {
+    vector<PendingCode> list;
+    t.maxLen = 0;
+    for (int i = 0; i < 256; ++i) {
+        if (codes.len[i] == 0) continue;
+        if (codes.len[i] > MAXPACKEDLEN) return false;
+        list.push_back({codes.code[i], codes.len[i], i});
+        t.maxLen = max(t.maxLen, (int)codes.len[i]);
+    }
+    t.entries.assign((size_t)1 << DecodeTable::PRIMARY_BITS, 0);
+    fillDecodeTable(t, 0, DecodeTable::PRIMARY_BITS, 0, list);
+    return true;
 }
 
-void buildInitial(const string &s) {
-    long long freq[256] = {0};
-    for (unsigned char c : s) freq[c]++;
-    nodeCount = 0;
+// MSB-first bit reader, the mirror of BitWriter: the next bits of the stream
+// sit at the top of `buf`. A refill loads 8 bytes at once and leaves at least
+// 56 valid bits; near the end it goes byte by byte and pads with zeros.
+struct BitReader {
+    const uint8_t *p, *end;
+    uint64_t buf = 0;
+    int n = 0;        // valid bits in buf
+    size_t padded = 0; // zero bytes supplied past the end
+
+    BitReader(const uint8_t *src, size_t bytes) : p(src), end(src + bytes) {}
+
+    void refill() {
+        if (end - p >= 8) {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            buf |= __builtin_bswap64(v) >> n;
+            p += (63 - n) >> 3;
+            n |= 56;
+            return;
+        }
+        while (n <= 56) {
+            if (p < end) buf |= (uint64_t)*p++ << (56 - n);
+            else padded++;
+            n += 8;
+        }
+    }
+    uint64_t peek(int bits) const { return buf >> (64 - bits); }
+    void consume(int bits) {
+        buf <<= bits;
+        n -= bits;
+    }
+};
+
+// One symbol through the table; false if the bits match no code
+inline bool decodeSymbol(const uint32_t *tab, BitReader &br, uint8_t *dst) {
+    uint32_t e = tab[br.peek(DecodeTable::PRIMARY_BITS)];
+    int bits = DecodeTable::PRIMARY_BITS;
+    while (e & DecodeTable::LINK) {
+        br.consume(bits);
+        bits = e & 0xff;
+        e = tab[((e & ~DecodeTable::LINK) >> 8) + br.peek(bits)];
+    }
+    br.consume(e & 0xff);
+    *dst = (uint8_t)(e >> 8);
+    return (e & 0xff) != 0;
+}
+
+// Symbols a refill is guaranteed to cover
+inline int symbolsPerRefill(const DecodeTable &t) { return max(1, 56 / max(t.maxLen, 1)); }
+
+// The last nsyms symbols of a stream, refilling carefully near its end
+bool decodeTail(const DecodeTable &t, BitReader &br, size_t nsyms, uint8_t *out) {
+    const uint32_t *tab = t.entries.data();
+    int perRefill = symbolsPerRefill(t);
+    size_t i = 0;
+    while (i < nsyms) {
+        br.refill();
+        int k = (int)min<size_t>(perRefill, nsyms - i);
+        for (int j = 0; j < k; ++j)
+            if (!decodeSymbol(tab, br, out + i++)) return false;
+        if (br.padded > 0 && (size_t)br.n < br.padded * 8) return false;
+    }
+    return true;
+}
+
+// Decodes nsyms symbols into out. Returns false on a bit pattern that is no
+// code, or if the codes run past the end of the input.
+bool decodeBits(const DecodeTable &t, const uint8_t *in, size_t bytes, size_t nsyms, uint8_t *out) {
+    const uint32_t *tab = t.entries.data();
+    BitReader br(in, bytes);
+    size_t i = 0;
+    int perRefill = symbolsPerRefill(t);
+    // bulk: whole refills' worth of symbols while 8 input bytes remain
+    bool ok = true;
+    while (br.end - br.p >= 8 && nsyms - i >= (size_t)perRefill) {
+        br.refill();
+        for (int j = 0; j < perRefill; ++j) ok &= decodeSymbol(tab, br, out + i + j);
+        i += perRefill;
+        if (!ok) return false;
+    }
+    return decodeTail(t, br, nsyms - i, out + i);
+}
+
+// ----------------------------------------------------------------------
+// Canonical, length-limited codes and the serialized length header
+// ----------------------------------------------------------------------
+const int MAXCODELEN = 15; // keeps decode tables to one secondary level
+
+// Caps byte code lengths at maxLen. Over-long codes are clamped, then the
+// Kraft sum is brought back to exactly 1 by moving codes down from shorter
+// lengths, one leaf at a time (the heuristic deflate encoders use); the
+// final lengths go to symbols by frequency, shortest to the most frequent.
+// Costs a fraction of a percent against optimal on real data, and only
+// when the tree was deeper than maxLen to begin with.
+void limitCodeLengths(uint8_t len[256], const long long freq[256], int maxLen) {
+    int count[MAXPACKEDLEN + 1] = {0};
+    int used = 0;
+    for (int i = 0; i < 256; ++i) {
+        if (!len[i]) continue;
+        count[min<int>(len[i], maxLen)]++;
+        used++;
+    }
+    if (used <= 1) return;
+    uint32_t kraft = 0;
+    for (int l = 1; l <= maxLen; ++l) kraft += (uint32_t)count[l] << (maxLen - l);
+    while (kraft > (1u << maxLen)) {
+        count[maxLen]--;
+        for (int l = maxLen - 1; l > 0; --l) {
+            if (count[l]) {
+                count[l]--;
+                count[l + 1] += 2;
+                break;
+            }
+        }
+        kraft--;
+    }
+    int syms[256], n = 0;
+    for (int i = 0; i < 256; ++i)
+        if (len[i]) syms[n++] = i;
+    stable_sort(syms, syms + n, [&](int a, int b) { return freq[a] > freq[b]; });
+    int k = 0;
+    for (int l = 1; l <= maxLen; ++l)
+        for (int c = 0; c < count[l]; ++c) len[syms[k++]] = (uint8_t)l;
+}
+
+// Canonical codes from lengths alone: shorter codes first, and within a
+// length in symbol order, so the lengths are all a decoder needs.
+void assignCanonicalCodes(const uint8_t len[256], BitCodes &codes) {
+    int count[MAXPACKEDLEN + 2] = {0};
+    codes.maxLen = 0;
+    for (int i = 0; i < 256; ++i) {
+        codes.len[i] = len[i];
+        count[len[i]]++;
+        codes.maxLen = max(codes.maxLen, (int)len[i]);
+    }
+    count[0] = 0;
+    uint64_t next[MAXPACKEDLEN + 2] = {0}, code = 0;
+    for (int l = 1; l <= codes.maxLen; ++l) {
+        code = (code + count[l - 1]) << 1;
+        next[l] = code;
+    }
+    for (int i = 0; i < 256; ++i) codes.code[i] = len[i] ? next[len[i]]++ : 0;
+}
+
+// Length header: one byte with (symbols used - 1), then
+//   up to 85 symbols: the symbol bytes, then their lengths two per byte
+//   more:             the lengths of all 256 bytes, two per byte
+// so a 3-symbol message costs 6 bytes and the worst case is 129.
+size_t writeLengthHeader(const BitCodes &codes, uint8_t *out) {
+    int syms[256], n = 0;
+    for (int i = 0; i < 256; ++i)
+        if (codes.len[i]) syms[n++] = i;
+    uint8_t *p = out;
+    *p++ = (uint8_t)(n - 1);
+    auto putNibbles = [&](int count, auto lenAt) {
+        for (int i = 0; i < count; i += 2)
+            *p++ = (uint8_t)(lenAt(i) << 4 | (i + 1 < count ? lenAt(i + 1) : 0));
+    };
+    if (n <= 85) {
+        for (int i = 0; i < n; ++i) *p++ = (uint8_t)syms[i];
+        putNibbles(n, [&](int i) { return codes.len[syms[i]]; });
+    } else {
+        putNibbles(256, [&](int i) { return codes.len[i]; });
+    }
+    return p - out;
+}
+
+// Returns the header size, or 0 if it is truncated or the lengths do not
+// form a usable prefix code
+size_t readLengthHeader(const uint8_t *in, size_t avail, BitCodes &codes) {
+    if (avail < 1) return 0;
+    int n = in[0] + 1;
+    size_t need = n <= 85 ? 1 + n + (n + 1) / 2 : 1 + 128;
+    if (avail < need) return 0;
+    uint8_t len[256] = {0};
+    if (n <= 85) {
+        const uint8_t *nib = in + 1 + n;
+        for (int i = 0; i < n; ++i) len[in[1 + i]] = nib[i / 2] >> (i % 2 ? 0 : 4) & 15;
+    } else {
+        for (int i = 0; i < 256; ++i) len[i] = in[1 + i / 2] >> (i % 2 ? 0 : 4) & 15;
+    }
+    uint32_t kraft = 0;
+    int used = 0;
     for (int i = 0; i < 256; ++i) {
-        if (freq[i] > 0) newNode((char)i, freq[i], -1, -1);
+        if (!len[i]) continue;
+        kraft += 1u << (MAXCODELEN - len[i]);
+        used++;
     }
-    if (nodeCount == 0) {
-        // empty input: create a dummy
-        newNode('\0', 1, -1, -1);
+    if (used != n || kraft > (1u << MAXCODELEN) || (used > 1 && kraft != (1u << MAXCODELEN))) return 0;
+    assignCanonicalCodes(len, codes);
+    return need;
+}
+
+void putVarint(vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// ----------------------------------------------------------------------
+// Interleaved streams
+// ----------------------------------------------------------------------
+// One bitstream is a serial chain: each code's position depends on the
+// length of the one before. Splitting the input into STREAMS consecutive
+// segments, each packed on its own, gives the decoder independent chains it
+// can advance in the same loop iteration. Layout:
+//   jump table: varint byte sizes of streams 0..STREAMS-2 (the last one
+//               takes the rest)
+//   the streams back to back, each zero-padded to a byte
+// Segment i holds symbols [i*seg, (i+1)*seg) with seg = ceil(n / STREAMS).
+const int STREAMS = 4;
+const size_t INTERLEAVE_MIN = 4096; // smaller messages keep one stream
+
+size_t encodeStreamsBound(const BitCodes &codes, size_t n) {
+    return (STREAMS - 1) * 10 + STREAMS * encodeBound(codes, (n + STREAMS - 1) / STREAMS);
+}
+
+// Returns the bytes written, or -1 as encodeBits would
+long long encodeStreams(const BitCodes &codes, const uint8_t *in, size_t n, uint8_t *out, size_t cap) {
+    if (cap < encodeStreamsBound(codes, n)) return -1;
+    size_t seg = (n + STREAMS - 1) / STREAMS;
+    // the streams go after the largest possible jump table, then move down
+    size_t at = (STREAMS - 1) * 10, total = 0, size[STREAMS];
+    for (int k = 0; k < STREAMS; ++k) {
+        size_t from = min(n, k * seg), len = min(n, from + seg) - from;
+        long long bits = encodeBits(codes, in + from, len, out + at + total, cap - at - total);
+        if (bits < 0) return -1;
+        size[k] = (bits + 7) / 8;
+        total += size[k];
+    }
+    vector<uint8_t> jump;
+    for (int k = 0; k + 1 < STREAMS; ++k) putVarint(jump, size[k]);
+    memmove(out + jump.size(), out + at, total);
+    memcpy(out, jump.data(), jump.size());
+    return (long long)(jump.size() + total);
+}
+
+// Decodes nsyms symbols from the STREAMS streams, one symbol from each per
+// step of the main loop; the ends of the streams finish one at a time
+bool decodeStreams(const DecodeTable &t, const uint8_t *in, size_t bytes, size_t nsyms, uint8_t *out) {
+    const uint8_t *p = in, *end = in + bytes;
+    uint64_t size[STREAMS - 1];
+    for (int k = 0; k + 1 < STREAMS; ++k)
+        if (!getVarint(p, end, size[k])) return false;
+    size_t seg = (nsyms + STREAMS - 1) / STREAMS;
+    BitReader br0(nullptr, 0), br1(nullptr, 0), br2(nullptr, 0), br3(nullptr, 0);
+    BitReader *br[STREAMS] = {&br0, &br1, &br2, &br3};
+    for (int k = 0; k < STREAMS; ++k) {
+        size_t len = k + 1 < STREAMS ? size[k] : (size_t)(end - p);
+        if (len > (size_t)(end - p)) return false;
+        *br[k] = BitReader(p, len);
+        p += len;
+    }
+    const uint32_t *tab = t.entries.data();
+    int perRefill = symbolsPerRefill(t);
+    // the last segment is the shortest, so it bounds the shared loop
+    size_t last = nsyms - min(nsyms, (STREAMS - 1) * seg), i = 0;
+    uint8_t *o0 = out, *o1 = out + seg, *o2 = out + 2 * seg, *o3 = out + 3 * seg;
+    bool ok = true;
+    while (last - i >= (size_t)perRefill && br0.end - br0.p >= 8 && br1.end - br1.p >= 8 &&
+           br2.end - br2.p >= 8 && br3.end - br3.p >= 8) {
+        br0.refill();
+        br1.refill();
+        br2.refill();
+        br3.refill();
+        for (int j = 0; j < perRefill; ++j, ++i) {
+            ok &= decodeSymbol(tab, br0, o0 + i);
+            ok &= decodeSymbol(tab, br1, o1 + i);
+            ok &= decodeSymbol(tab, br2, o2 + i);
+            ok &= decodeSymbol(tab, br3, o3 + i);
+        }
+        if (!ok) return false;
+    }
+    for (int k = 0; k < STREAMS; ++k) {
+        size_t from = min(nsyms, k * seg), len = min(nsyms, from + seg) - from;
+        if (!decodeTail(t, *br[k], len - i, out + from + i)) return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// HuffmanCodec: the fixed node array and the code tables of one codec
+// ----------------------------------------------------------------------
+// Everything a message touches lives in the instance, so codecs on
+// different threads share nothing. The node pool is sized once for the
+// alphabet and every later message reuses it, as do the scratch arrays and
+// the decode table.
+class HuffmanCodec {
+private:
+    int maxSymbols;
+    vector<Node> nodeArray; // 2 x alphabet, never reallocated
+    int nodeCount = 0;
+    vector<int> order;      // leaves by (freq, index), for the two-queue build
+    vector<int> depth;      // per node, for codeLengths
+    vector<int> lengths;    // per symbol, for generateCanonicalCodes
+    string codeTable[256];
+    BitCodes bitCodes;
+    DecodeTable decodeTable;
+
+    int newNode(int c, long long f, int l=-1, int r=-1) {
+        nodeArray[nodeCount].sym = c;
+        nodeArray[nodeCount].freq = f;
+        nodeArray[nodeCount].left = l;
+        nodeArray[nodeCount].right = r;
+        nodeArray[nodeCount].active = true;
+        return nodeCount++;
+    }
+
+    void buildCodesRec(int idx, string path) {
+        if (idx < 0) return;
+        if (nodeArray[idx].left == -1 && nodeArray[idx].right == -1) {
+            // leaf
+            unsigned char uc = (unsigned char)nodeArray[idx].sym;
+            codeTable[uc] = (path.empty() ? "0" : path); // edge-case: single symbol -> "0"
+            return;
+        }
+        if (nodeArray[idx].left != -1) buildCodesRec(nodeArray[idx].left, path + "0");
+        if (nodeArray[idx].right != -1) buildCodesRec(nodeArray[idx].right, path + "1");
+    }
+
+public:
+    // alphabet: symbols 0..alphabet-1 (at most MAXSYMS); bytes need 256
+    explicit HuffmanCodec(int alphabet = 256)
+        : maxSymbols(min(max(alphabet, 1), MAXSYMS)), nodeArray(2 * maxSymbols),
+          order(maxSymbols), depth(2 * maxSymbols), lengths(maxSymbols) {}
+
+    // threads > 1 splits the byte count of large inputs across threads
+    void buildInitial(const string &s, int threads = 1) {
+        long long freq[256] = {0};
+        byteHistogramParallel((const uint8_t *)s.data(), s.size(), freq, threads);
+        nodeCount = 0;
+        for (int i = 0; i < 256; ++i) {
+            if (freq[i] > 0) newNode(i, freq[i], -1, -1);
+        }
+        if (nodeCount == 0) {
+            // empty input: create a dummy
+            newNode(0, 1, -1, -1);
+        }
+    }
+
+    // Same as buildInitial, for an arbitrary alphabet (symbols past the
+    // codec's alphabet are ignored)
+    void buildInitialCounts(const long long *freq, int n) {
+        nodeCount = 0;
+        for (int i = 0; i < n && i < maxSymbols; ++i) {
+            if (freq[i] > 0) newNode(i, freq[i], -1, -1);
+        }
+        if (nodeCount == 0) newNode(0, 1, -1, -1);
+    }
+    void buildInitialCounts(const vector<long long> &freq) { buildInitialCounts(freq.data(), (int)freq.size()); }
+
+    // Linear two-queue construction: leaves sorted by (freq, index) in one
+    // queue, parents in creation order in the other (their freqs never
+    // decrease). Taking the smaller front, leaves first on ties, picks exactly
+    // the nodes the scan below picks, so the tree comes out identical.
+    int buildHuffmanTree() {
+        int leaves = nodeCount;
+        if (leaves == 1) return 0;
+        for (int i = 0; i < leaves; ++i) order[i] = i;
+        sort(order.begin(), order.begin() + leaves, [this](int a, int b) {
+            if (nodeArray[a].freq != nodeArray[b].freq) return nodeArray[a].freq < nodeArray[b].freq;
+            return a < b;
+        });
+        int leafHead = 0, parentHead = leaves;
+        auto takeMin = [&]() {
+            int i;
+            if (parentHead == nodeCount ||
+                (leafHead < leaves && nodeArray[order[leafHead]].freq <= nodeArray[parentHead].freq))
+                i = order[leafHead++];
+            else
+                i = parentHead++;
+            nodeArray[i].active = false;
+            return i;
+        };
+        for (int merges = 0; merges < leaves - 1; ++merges) {
+            int min1 = takeMin();
+            int min2 = takeMin();
+            newNode(0, nodeArray[min1].freq + nodeArray[min2].freq, min1, min2);
+        }
+        return nodeCount - 1;
+    }
+
+    // The original O(n^2) construction, kept as the reference for --bench
+    int buildHuffmanTreeScan() {
+        if (nodeCount == 1) return 0;
+        while (true) {
+            // count active nodes
+            int activeCount = 0;
+            for (int i = 0; i < nodeCount; ++i) if (nodeArray[i].active) activeCount++;
+            if (activeCount <= 1) {
+                // find root index
+                for (int i = 0; i < nodeCount; ++i) if (nodeArray[i].active) return i;
+            }
+            // find two minimum active nodes
+            int min1 = -1, min2 = -1;
+            for (int i = 0; i < nodeCount; ++i) {
+                if (!nodeArray[i].active) continue;
+                if (min1 == -1 || nodeArray[i].freq < nodeArray[min1].freq) {
+                    min2 = min1;
+                    min1 = i;
+                } else if (min2 == -1 || nodeArray[i].freq < nodeArray[min2].freq) {
+                    min2 = i;
+                }
+            }
+            // create parent node combining min1 and min2
+            long long fsum = nodeArray[min1].freq + nodeArray[min2].freq;
+            int left = min1;
+            int right = min2;
+            // mark children inactive (they remain as nodes but not considered active leaves)
+            nodeArray[min1].active = false;
+            nodeArray[min2].active = false;
+            // allocate new parent node
+            newNode(0, fsum, left, right);
+            // continue until only one active node (the root) remains
+        }
+    }
+
+    // Code length of every symbol, without recursion: parents are created after
+    // their children, so one pass down the node indices sees each parent first.
+    // A single-symbol tree gets length 1, like buildCodesRec.
+    void codeLengths(int root, vector<int> &len) {
+        len.assign(maxSymbols, 0);
+        depth[root] = 0;
+        for (int i = root; i >= 0; --i) {
+            const Node &n = nodeArray[i];
+            if (n.left == -1 && n.right == -1) {
+                len[n.sym] = max(depth[i], 1);
+                continue;
+            }
+            if (n.left != -1) depth[n.left] = depth[i] + 1;
+            if (n.right != -1) depth[n.right] = depth[i] + 1;
+        }
+    }
+
+    void generateCodes(int root) {
+        for (int i = 0; i < 256; ++i) codeTable[i].clear();
+        buildCodesRec(root, "");
+        bitCodes.maxLen = 0;
+        for (int i = 0; i < 256; ++i) {
+            const string &path = codeTable[i];
+            bitCodes.code[i] = 0;
+            bitCodes.len[i] = (uint8_t)min<size_t>(path.size(), 255);
+            bitCodes.maxLen = max(bitCodes.maxLen, (int)path.size());
+            if (path.size() > MAXPACKEDLEN) continue;
+            for (char b : path) bitCodes.code[i] = bitCodes.code[i] << 1 | (b == '1');
+        }
+    }
+
+    // Lengths from the tree at `root`, capped at maxLen, made canonical; fills
+    // bitCodes and the readable codeTable
+    void generateCanonicalCodes(int root, int maxLen = MAXCODELEN) {
+        codeLengths(root, lengths);
+        uint8_t len[256] = {0};
+        long long freq[256] = {0};
+        for (int i = 0; i < min(maxSymbols, 256); ++i) len[i] = (uint8_t)min(lengths[i], 255);
+        for (int i = 0; i < nodeCount && nodeArray[i].left == -1; ++i)
+            if (nodeArray[i].sym < 256) freq[nodeArray[i].sym] = nodeArray[i].freq;
+        limitCodeLengths(len, freq, maxLen);
+        assignCanonicalCodes(len, bitCodes);
+        for (int i = 0; i < 256; ++i) {
+            codeTable[i].clear();
+            for (int b = len[i] - 1; b >= 0; --b) codeTable[i] += (bitCodes.code[i] >> b & 1) ? '1' : '0';
+        }
+    }
+
+    // One char per bit; readable, 8x the size of the real output (see encodeBits)
+    string encodeString(const string &s) const {
+        string out;
+        for (unsigned char c : s) {
+            out += codeTable[c];
+        }
+        return out;
+    }
+
+    // Self-contained message: length header, varint byte count, packed codes
+    // (as interleaved streams from INTERLEAVE_MIN bytes up)
+    void compress(const uint8_t *in, size_t n, vector<uint8_t> &out) {
+        long long freq[256] = {0};
+        byteHistogram(in, n, freq);
+        buildInitialCounts(freq, 256);
+        generateCanonicalCodes(buildHuffmanTree());
+        out.resize(130);
+        out.resize(writeLengthHeader(bitCodes, out.data()));
+        putVarint(out, n);
+        size_t at = out.size();
+        if (n >= INTERLEAVE_MIN) {
+            out.resize(at + encodeStreamsBound(bitCodes, n));
+            out.resize(at + encodeStreams(bitCodes, in, n, out.data() + at, out.size() - at));
+            return;
+        }
+        out.resize(at + encodeBound(bitCodes, n));
+        long long bits = encodeBits(bitCodes, in, n, out.data() + at, out.size() - at);
+        out.resize(at + (bits + 7) / 8);
+    }
+
+    bool decompress(const uint8_t *in, size_t size, vector<uint8_t> &out) {
+        size_t h = readLengthHeader(in, size, bitCodes);
+        if (!h) return false;
+        const uint8_t *p = in + h, *end = in + size;
+        uint64_t n;
+        if (!getVarint(p, end, n) || n > (uint64_t)(end - p) * 8) return false;
+        buildDecodeTable(bitCodes, decodeTable);
+        out.resize(n);
+        if (n >= INTERLEAVE_MIN) return decodeStreams(decodeTable, p, end - p, n, out.data());
+        return decodeBits(decodeTable, p, end - p, n, out.data());
+    }
+
+    int alphabet() const { return maxSymbols; }
+    const Node &node(int i) const { return nodeArray[i]; }
+    const string &code(int c) const { return codeTable[c]; }
+    const BitCodes &codes() const { return bitCodes; }
+};
+
+// ----------------------------------------------------------------------
+// Block-parallel file compressor
+// ----------------------------------------------------------------------
+// Container:
+//   "HUF2", uint32 block size ("HUF1" had single-stream blocks)
+//   blocks, each a self-contained HuffmanCodec::compress message
+//   index: per block uint64 offset, uint32 packed size, uint32 raw size
+//   footer: uint64 index offset, uint32 block count, "HIDX"
+// All integers little-endian. The index at the end lets a reader jump to
+// any block, and blocks decode independently of each other.
+
+const uint32_t DEFAULT_BLOCK = 1 << 20;
+
+struct BlockInfo {
+    uint64_t offset;
+    uint32_t packed, raw;
+};
+
+// Fixed set of workers draining one FIFO of jobs
+class ThreadPool {
+private:
+    vector<thread> workers;
+    deque<function<void()>> jobs;
+    mutex m;
+    condition_variable cv;
+    bool stopping = false;
+
+public:
+    explicit ThreadPool(int threads) {
+        for (int i = 0; i < max(threads, 1); ++i)
+            workers.emplace_back([this] {
+                while (true) {
+                    function<void()> job;
+                    {
+                        unique_lock<mutex> lk(m);
+                        cv.wait(lk, [&] { return stopping || !jobs.empty(); });
+                        if (jobs.empty()) return;
+                        job = move(jobs.front());
+                        jobs.pop_front();
+                    }
+                    job();
+                }
+            });
+    }
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lk(m);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto &w : workers) w.join();
+    }
+    template<class F>
+    future<invoke_result_t<F>> submit(F f) {
+        auto task = make_shared<packaged_task<invoke_result_t<F>()>>(move(f));
+        {
+            lock_guard<mutex> lk(m);
+            jobs.emplace_back([task] { (*task)(); });
+        }
+        cv.notify_one();
+        return task->get_future();
     }
+};
+
+template<class T>
+void putLE(FILE *f, T v) {
+    uint8_t b[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); ++i) b[i] = (uint8_t)(v >> (8 * i));
+    fwrite(b, 1, sizeof(T), f);
 }
 
-int buildHuffmanTree() {
-    if (nodeCount == 1) return 0;
+template<class T>
+T getLE(const uint8_t *p) {
+    T v = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) v |= (T)p[i] << (8 * i);
+    return v;
+}
+
+// Streams `in` ("-" = stdin) through in blockSize reads. Each block gets
+// its own histogram and code table and is compressed on the pool; at most
+// 2 x threads blocks are in flight, and they are written back in order.
+bool compressFile(const string &inPath, const string &outPath, int threads, uint32_t blockSize = DEFAULT_BLOCK) {
+    FILE *in = inPath == "-" ? stdin : fopen(inPath.c_str(), "rb");
+    if (!in) return false;
+    FILE *out = fopen(outPath.c_str(), "wb");
+    if (!out) {
+        if (in != stdin) fclose(in);
+        return false;
+    }
+    fwrite("HUF2", 1, 4, out);
+    putLE<uint32_t>(out, blockSize);
+
+    ThreadPool pool(threads);
+    deque<future<vector<uint8_t>>> inFlight;
+    deque<uint32_t> rawSizes;
+    vector<BlockInfo> index;
+    uint64_t offset = 8;
+    auto writeFront = [&] {
+        vector<uint8_t> packed = inFlight.front().get();
+        fwrite(packed.data(), 1, packed.size(), out);
+        index.push_back({offset, (uint32_t)packed.size(), rawSizes.front()});
+        offset += packed.size();
+        inFlight.pop_front();
+        rawSizes.pop_front();
+    };
     while (true) {
-        // count active nodes
-        int activeCount = 0;
-        for (int i = 0; i < nodeCount; ++i) if (nodeArray[i].active) activeCount++;
-        if (activeCount <= 1) {
-            // find root index
-            for (int i = 0; i < nodeCount; ++i) if (nodeArray[i].active) return i;
-        }
-        // find two minimum active nodes
-        int min1 = -1, min2 = -1;
-        for (int i = 0; i < nodeCount; ++i) {
-            if (!nodeArray[i].active) continue;
-            if (min1 == -1 || nodeArray[i].freq < nodeArray[min1].freq) {
-                min2 = min1;
-                min1 = i;
-            } else if (min2 == -1 || nodeArray[i].freq < nodeArray[min2].freq) {
-                min2 = i;
+        auto block = make_shared<vector<uint8_t>>(blockSize);
+        size_t got = fread(block->data(), 1, blockSize, in);
+        if (got == 0) break;
+        block->resize(got);
+        inFlight.push_back(pool.submit([block] {
+            static thread_local HuffmanCodec codec; // one per worker, reused
+            vector<uint8_t> packed;
+            codec.compress(block->data(), block->size(), packed);
+            return packed;
+        }));
+        rawSizes.push_back((uint32_t)got);
+        if (inFlight.size() >= (size_t)max(threads, 1) * 2) writeFront();
+    }
+    while (!inFlight.empty()) writeFront();
+    bool ok = !ferror(in);
+    for (const BlockInfo &b : index) {
+        putLE<uint64_t>(out, b.offset);
+        putLE<uint32_t>(out, b.packed);
+        putLE<uint32_t>(out, b.raw);
+    }
+    putLE<uint64_t>(out, offset);
+    putLE<uint32_t>(out, (uint32_t)index.size());
+    fwrite("HIDX", 1, 4, out);
+    ok = !ferror(out) && ok;
+    if (in != stdin) fclose(in);
+    return fclose(out) == 0 && ok;
+}
+
+// Reads the footer and block index of a container
+bool readBlockIndex(ifstream &f, vector<BlockInfo> &index, uint32_t &blockSize) {
+    uint8_t head[8], foot[16];
+    f.seekg(0, ios::end);
+    uint64_t size = (uint64_t)f.tellg();
+    if (size < 24) return false;
+    f.seekg(0);
+    f.read((char *)head, 8);
+    f.seekg(size - 16);
+    f.read((char *)foot, 16);
+    if (!f || memcmp(head, "HUF2", 4) != 0 || memcmp(foot + 12, "HIDX", 4) != 0) return false;
+    blockSize = getLE<uint32_t>(head + 4);
+    uint64_t at = getLE<uint64_t>(foot);
+    uint32_t count = getLE<uint32_t>(foot + 8);
+    if (at + (uint64_t)count * 16 + 16 != size) return false;
+    vector<uint8_t> raw((size_t)count * 16);
+    f.seekg(at);
+    f.read((char *)raw.data(), raw.size());
+    if (!f) return false;
+    index.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint8_t *p = raw.data() + i * 16;
+        index[i] = {getLE<uint64_t>(p), getLE<uint32_t>(p + 8), getLE<uint32_t>(p + 12)};
+        if (index[i].offset + index[i].packed > at || index[i].raw > blockSize) return false;
+    }
+    return true;
+}
+
+bool decompressBlock(ifstream &f, const BlockInfo &b, vector<uint8_t> &raw) {
+    static thread_local HuffmanCodec codec;
+    vector<uint8_t> packed(b.packed);
+    f.seekg(b.offset);
+    f.read((char *)packed.data(), packed.size());
+    return f && codec.decompress(packed.data(), packed.size(), raw) && raw.size() == b.raw;
+}
+
+// Whole file, blocks decoded on the pool and written in order. Each job
+// opens its own stream so reads do not share a file position.
+bool decompressFile(const string &inPath, const string &outPath, int threads) {
+    ifstream f(inPath, ios::binary);
+    vector<BlockInfo> index;
+    uint32_t blockSize;
+    if (!f || !readBlockIndex(f, index, blockSize)) return false;
+    FILE *out = outPath == "-" ? stdout : fopen(outPath.c_str(), "wb");
+    if (!out) return false;
+    ThreadPool pool(threads);
+    deque<future<pair<bool, vector<uint8_t>>>> inFlight;
+    bool ok = true;
+    auto writeFront = [&] {
+        auto r = inFlight.front().get();
+        ok = ok && r.first;
+        if (ok) fwrite(r.second.data(), 1, r.second.size(), out);
+        inFlight.pop_front();
+    };
+    for (const BlockInfo &b : index) {
+        inFlight.push_back(pool.submit([&inPath, b] {
+            ifstream fb(inPath, ios::binary);
+            vector<uint8_t> raw;
+            bool good = decompressBlock(fb, b, raw);
+            return make_pair(good, move(raw));
+        }));
+        if (inFlight.size() >= (size_t)max(threads, 1) * 2) writeFront();
+    }
+    while (!inFlight.empty()) writeFront();
+    ok = !ferror(out) && ok;
+    if (out == stdout) return fflush(out) == 0 && ok;
+    return fclose(out) == 0 && ok;
+}
+
+// Random access: decodes only block `which`
+bool extractBlock(const string &inPath, size_t which, vector<uint8_t> &raw) {
+    ifstream f(inPath, ios::binary);
+    vector<BlockInfo> index;
+    uint32_t blockSize;
+    if (!f || !readBlockIndex(f, index, blockSize) || which >= index.size()) return false;
+    return decompressBlock(f, index[which], raw);
+}
+
+// ----------------------------------------------------------------------
+// Adaptive one-pass Huffman (FGK) for unbounded streams
+// ----------------------------------------------------------------------
+// Encoder and decoder grow the same tree as symbols go by, so nothing is
+// counted up front and each byte is coded as soon as it arrives. Symbols not
+// seen yet are sent as the NYT ("not yet transmitted") code followed by the
+// raw 9-bit symbol; symbol 256 marks the end of the stream.
+//
+// The tree sits in a fixed array whose index is the node's number in the
+// sibling property: weights never decrease with the index, the root is the
+// last slot and the NYT node is always the lowest used one. An update walks
+// from the symbol's leaf to the root, swapping each node with the highest-
+// numbered node of equal weight before incrementing it; that node is found
+// by binary search over the slots above it, so the work per symbol is
+// O(code length x log alphabet).
+class AdaptiveHuffman {
+public:
+    static const int SYMBOLS = 257; // bytes + end of stream
+    static const int END = 256;
+    static const int MAXN = 2 * SYMBOLS + 1; // 257 leaves, NYT, internals
+    static const int RAWBITS = 9;
+
+private:
+    struct ANode {
+        long long weight;
+        int parent, left, right; // left == -1: leaf
+        int sym;                 // leaf symbol, -1 for NYT
+    };
+    ANode nodes[MAXN];
+    int leafOf[SYMBOLS];
+    int nyt;
+
+    static const int ROOT = MAXN - 1;
+
+    // highest-numbered node with the same weight as p; slots above p are
+    // always ordered, even while p's subtree is mid-update
+    int leader(int p) const {
+        int lo = p, hi = ROOT;
+        long long w = nodes[p].weight;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (nodes[mid].weight == w) lo = mid;
+            else hi = mid - 1;
+        }
+        return lo;
+    }
+
+    // a and b trade places in the tree; weights are equal, parents stay put
+    void interchange(int a, int b) {
+        if (a == b) return;
+        swap(nodes[a].left, nodes[b].left);
+        swap(nodes[a].right, nodes[b].right);
+        swap(nodes[a].sym, nodes[b].sym);
+        for (int i : {a, b}) {
+            if (nodes[i].left != -1) {
+                nodes[nodes[i].left].parent = i;
+                nodes[nodes[i].right].parent = i;
+            } else if (nodes[i].sym >= 0) {
+                leafOf[nodes[i].sym] = i;
+            } else {
+                nyt = i;
             }
         }
-        // create parent node combining min1 and min2
-        long long fsum = nodeArray[min1].freq + nodeArray[min2].freq;
-        int left = min1;
-        int right = min2;
-        // mark children inactive (they remain as nodes but not considered active leaves)
-        nodeArray[min1].active = false;
-        nodeArray[min2].active = false;
-        // allocate new parent node
-        newNode('\0', fsum, left, right);
-        // continue until only one active node (the root) remains
-    }
-}
-
-void buildCodesRec(int idx, string path) {
-    if (idx < 0) return;
-    if (nodeArray[idx].left == -1 && nodeArray[idx].right == -1) {
-        // leaf
-        unsigned char uc = (unsigned char)nodeArray[idx].ch;
-        codeTable[uc] = (path.empty() ? "0" : path); // edge-case: single symbol -> "0"
-        return;
     }
-    if (nodeArray[idx].left != -1) buildCodesRec(nodeArray[idx].left, path + "0");
-    if (nodeArray[idx].right != -1) buildCodesRec(nodeArray[idx].right, path + "1");
+
+public:
+    AdaptiveHuffman() { reset(); }
+
+    void reset() {
+        fill(leafOf, leafOf + SYMBOLS, -1);
+        nyt = ROOT;
+        nodes[ROOT] = {0, -1, -1, -1, -1};
+    }
+
+    int root() const { return ROOT; }
+    bool isLeaf(int i) const { return nodes[i].left == -1; }
+    int child(int i, int bit) const { return bit ? nodes[i].right : nodes[i].left; }
+    int symbolAt(int i) const { return nodes[i].sym; } // -1 = NYT
+    bool known(int c) const { return leafOf[c] != -1; }
+
+    // Bits of the code for c, or of the NYT code if c is new; written into
+    // bits[] root first, returns how many. The caller adds the raw symbol
+    // after an NYT code.
+    int path(int c, uint8_t *bits, bool &escaped) const {
+        int i = leafOf[c];
+        escaped = i == -1;
+        if (escaped) i = nyt;
+        int n = 0;
+        for (; i != ROOT; i = nodes[i].parent) bits[n++] = nodes[nodes[i].parent].right == i;
+        reverse(bits, bits + n);
+        return n;
+    }
+
+    void update(int c) {
+        int q = leafOf[c];
+        if (q == -1) {
+            // NYT becomes a parent: new NYT on the left, c's leaf on the right.
+            // The leaf takes its count directly; the old NYT slot is then the
+            // only weight-0 node above the new ones, so no swap is needed there.
+            int z = nyt;
+            nodes[z - 2] = {0, z, -1, -1, -1};
+            nodes[z - 1] = {1, z, -1, -1, c};
+            nodes[z].left = z - 2;
+            nodes[z].right = z - 1;
+            nodes[z].sym = -1;
+            nyt = z - 2;
+            leafOf[c] = z - 1;
+            q = z;
+        }
+        while (q != -1) {
+            if (q != ROOT) {
+                // the leader is q's parent only when q's sibling is the NYT
+                // node; q then stays where it is
+                int l = leader(q);
+                if (l != nodes[q].parent) {
+                    interchange(q, l);
+                    q = l;
+                }
+            }
+            nodes[q].weight++;
+            q = nodes[q].parent;
+        }
+    }
+
+    // Sibling property and weight sums hold; used by --fuzz
+    bool valid() const {
+        for (int i = nyt; i < ROOT; ++i)
+            if (nodes[i].weight > nodes[i + 1].weight) return false;
+        for (int i = nyt; i <= ROOT; ++i) {
+            const ANode &n = nodes[i];
+            if (n.left != -1 && n.weight != nodes[n.left].weight + nodes[n.right].weight) return false;
+        }
+        return true;
+    }
+};
+
+// Streaming encoder: put() codes one byte and returns how many whole
+// output bytes are ready in out(); finish() adds the end marker and pads.
+class AdaptiveEncoder {
+private:
+    AdaptiveHuffman model;
+    vector<uint8_t> buf;
+    uint32_t acc = 0;
+    int n = 0; // pending bits, < 8 between calls
+
+    void bit(int b) {
+        acc = acc << 1 | b;
+        if (++n == 8) {
+            buf.push_back((uint8_t)acc);
+            acc = 0;
+            n = 0;
+        }
+    }
+    void code(int c) {
+        uint8_t bits[AdaptiveHuffman::MAXN];
+        bool escaped;
+        int len = model.path(c, bits, escaped);
+        for (int i = 0; i < len; ++i) bit(bits[i]);
+        if (escaped)
+            for (int i = AdaptiveHuffman::RAWBITS - 1; i >= 0; --i) bit(c >> i & 1);
+        model.update(c);
+    }
+
+public:
+    // Bytes completed so far; the caller sends them and then calls take()
+    const vector<uint8_t> &out() const { return buf; }
+    void take() { buf.clear(); }
+
+    size_t put(uint8_t c) {
+        code(c);
+        return buf.size();
+    }
+    size_t finish() {
+        code(AdaptiveHuffman::END);
+        while (n) bit(0);
+        return buf.size();
+    }
+};
+
+// Streaming decoder: feed() takes input in chunks of any size, split
+// anywhere, and appends each byte as soon as its last bit has arrived.
+// Returns false on a malformed stream; done() once the end marker is seen.
+class AdaptiveDecoder {
+private:
+    AdaptiveHuffman model;
+    int at;       // position of the tree walk
+    int raw;      // bits of an escaped symbol still due, 0 = walking
+    int rawValue;
+    bool ended = false;
+
+    // Back at the root. While the root is still the bare NYT leaf its code
+    // is empty, so the raw symbol follows at once.
+    void startSymbol() {
+        at = model.root();
+        raw = model.isLeaf(at) ? AdaptiveHuffman::RAWBITS : 0;
+        rawValue = 0;
+    }
+
+public:
+    AdaptiveDecoder() { startSymbol(); }
+
+    const AdaptiveHuffman &tree() const { return model; }
+    bool done() const { return ended; }
+
+    bool feed(const uint8_t *data, size_t len, vector<uint8_t> &out) {
+        for (size_t i = 0; i < len && !ended; ++i) {
+            for (int k = 7; k >= 0 && !ended; --k) {
+                int b = data[i] >> k & 1;
+                int c;
+                if (raw > 0) {
+                    rawValue = rawValue << 1 | b;
+                    if (--raw > 0) continue;
+                    // known symbols never take the escape
+                    c = rawValue;
+                    if (c >= AdaptiveHuffman::SYMBOLS || model.known(c)) return false;
+                } else {
+                    at = model.child(at, b);
+                    if (!model.isLeaf(at)) continue;
+                    c = model.symbolAt(at);
+                    if (c < 0) {
+                        raw = AdaptiveHuffman::RAWBITS;
+                        rawValue = 0;
+                        continue;
+                    }
+                }
+                if (c == AdaptiveHuffman::END) {
+                    ended = true;
+                    break;
+                }
+                out.push_back((uint8_t)c);
+                model.update(c);
+                startSymbol();
+            }
+        }
+        return true;
+    }
+};
+
+// One read of whatever input is available, so a live pipe is coded as it
+// arrives instead of waiting for a full buffer. 0 = end of input.
+size_t readSome(FILE *f, uint8_t *buf, size_t cap) {
+#ifndef _WIN32
+    ssize_t r = read(fileno(f), buf, cap);
+    return r > 0 ? (size_t)r : 0;
+#else
+    return fread(buf, 1, cap, f);
+#endif
+}
+
+// stdin -> stdout; completed output bytes are flushed after every read
+bool adaptiveEncodeStream(FILE *in, FILE *out) {
+    AdaptiveEncoder enc;
+    vector<uint8_t> buf(1 << 16);
+    while (size_t got = readSome(in, buf.data(), buf.size())) {
+        for (size_t i = 0; i < got; ++i) enc.put(buf[i]);
+        fwrite(enc.out().data(), 1, enc.out().size(), out);
+        enc.take();
+        fflush(out);
+    }
+    enc.finish();
+    fwrite(enc.out().data(), 1, enc.out().size(), out);
+    return fflush(out) == 0;
+}
+
+bool adaptiveDecodeStream(FILE *in, FILE *out) {
+    AdaptiveDecoder dec;
+    vector<uint8_t> buf(1 << 16), raw;
+    while (!dec.done()) {
+        size_t got = readSome(in, buf.data(), buf.size());
+        if (!got) return false; // ended before the end marker
+        raw.clear();
+        if (!dec.feed(buf.data(), got, raw)) return false;
+        fwrite(raw.data(), 1, raw.size(), out);
+        fflush(out);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------
+// Benchmarks and checks (run with --bench, --encode-bench [MB],
+// --decode-bench [MB], --fuzz [iterations], --hist-bench [MB] [threads],
+// --messages [count] [threads], --file-bench [MB] [threads],
+// --adaptive-bench [MB], --suite [max MB])
+// ----------------------------------------------------------------------
+template<class F>
+double timeMs(F f) {
+    auto t0 = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+// Scan vs two-queue tree construction
+void runTreeBenchmark() {
+    mt19937_64 rng(11);
+    cout << "Tree construction, scan vs two-queue\n";
+    for (int n : {256, 4096, 65536}) {
+        vector<long long> freq(n);
+        // Zipf-like counts, so there are plenty of ties and a deep tree
+        for (int i = 0; i < n; ++i) freq[i] = 1 + (long long)(1000000.0 / (1 + i % 1000)) + rng() % 3;
+        vector<int> a, b;
+        int root = 0;
+        double tScan = 0, tQueue = 0;
+        HuffmanCodec codec(n);
+        codec.buildInitialCounts(freq);
+        tScan = timeMs([&] { root = codec.buildHuffmanTreeScan(); });
+        codec.codeLengths(root, a);
+        int reps = n <= 4096 ? 100 : 10;
+        for (int r = 0; r < reps; ++r) {
+            codec.buildInitialCounts(freq);
+            tQueue += timeMs([&] { root = codec.buildHuffmanTree(); });
+        }
+        tQueue /= reps;
+        codec.codeLengths(root, b);
+        cout << "  " << setw(5) << n << " symbols: scan " << tScan << " ms, two-queue " << tQueue
+             << " ms (" << tScan / tQueue << "x), same lengths: " << (a == b ? "yes" : "NO") << "\n";
+    }
+}
+
+// English-like text: words drawn from a small skewed vocabulary
+string makeTextCorpus(size_t bytes, unsigned seed) {
+    static const char *words[] = {"the", "of", "and", "to", "in", "a", "is", "that", "for", "it",
+                                  "as", "was", "with", "be", "by", "on", "not", "he", "this", "are",
+                                  "patient", "queue", "severity", "doctor", "huffman", "tree", "node"};
+    const int nw = sizeof(words) / sizeof(words[0]);
+    mt19937 rng(seed);
+    string s;
+    s.reserve(bytes + 16);
+    while (s.size() < bytes) {
+        int r = (int)(rng() % (nw * (nw + 1) / 2)), w = 0;
+        while (r >= nw - w) r -= nw - w++;  // word w with weight nw - w
+        s += words[w];
+        s += rng() % 12 == 0 ? ".\n" : " ";
+    }
+    s.resize(bytes);
+    return s;
+}
+
+// Packed encoder throughput vs the '0'/'1' string
+void runEncodeBenchmark(int mb) {
+    string text = makeTextCorpus((size_t)mb << 20, 3);
+    HuffmanCodec codec;
+    codec.buildInitial(text);
+    codec.generateCodes(codec.buildHuffmanTree());
+    const BitCodes &bitCodes = codec.codes();
+    vector<uint8_t> out(encodeBound(bitCodes, text.size()));
+    long long bits = 0;
+    double tPacked = 1e30;
+    for (int r = 0; r < 5; ++r)
+        tPacked = min(tPacked, timeMs([&] {
+            bits = encodeBits(bitCodes, (const uint8_t *)text.data(), text.size(), out.data(), out.size());
+        }));
+    size_t chars = 0;
+    double tString = timeMs([&] { chars = codec.encodeString(text).size(); });
+    double mbIn = text.size() / 1048576.0;
+    cout << "Encode " << mb << " MB of text (max code " << bitCodes.maxLen << " bits)\n";
+    cout << "  '0'/'1' string: " << mbIn / tString * 1000 << " MB/s, " << chars / 1048576.0 << " MB out\n";
+    cout << "  packed bits:    " << mbIn / tPacked * 1000 << " MB/s, " << (bits + 7) / 8 / 1048576.0
+         << " MB out, bit counts agree: " << ((size_t)bits == chars ? "yes" : "NO") << "\n";
+}
+
+// Reference decoder: one tree step per bit
+size_t decodeTreeWalk(const HuffmanCodec &codec, int root, const uint8_t *in, size_t nsyms, uint8_t *out) {
+    size_t bit = 0;
+    for (size_t i = 0; i < nsyms; ++i) {
+        int idx = root;
+        if (codec.node(idx).left == -1) bit++; // single-symbol tree, code "0"
+        while (codec.node(idx).left != -1) {
+            int b = in[bit >> 3] >> (7 - (bit & 7)) & 1;
+            idx = b ? codec.node(idx).right : codec.node(idx).left;
+            bit++;
+        }
+        out[i] = (uint8_t)codec.node(idx).sym;
+    }
+    return bit;
+}
+
+// Table decoder vs a bit-at-a-time tree walk
+void runDecodeBenchmark(int mb) {
+    string text = makeTextCorpus((size_t)mb << 20, 4);
+    HuffmanCodec codec;
+    codec.buildInitial(text);
+    int root = codec.buildHuffmanTree();
+    codec.generateCodes(root);
+    const BitCodes &bitCodes = codec.codes();
+    vector<uint8_t> packed(encodeBound(bitCodes, text.size()));
+    long long bits = encodeBits(bitCodes, (const uint8_t *)text.data(), text.size(), packed.data(), packed.size());
+    DecodeTable table;
+    buildDecodeTable(bitCodes, table);
+    vector<uint8_t> a(text.size()), b(text.size());
+    bool ok = true;
+    double tTable = 1e30;
+    for (int r = 0; r < 5; ++r)
+        tTable = min(tTable, timeMs([&] { ok = decodeBits(table, packed.data(), (bits + 7) / 8, a.size(), a.data()) && ok; }));
+    double tWalk = timeMs([&] { decodeTreeWalk(codec, root, packed.data(), b.size(), b.data()); });
+    vector<uint8_t> streams(encodeStreamsBound(bitCodes, text.size())), c(text.size());
+    long long sbytes = encodeStreams(bitCodes, (const uint8_t *)text.data(), text.size(), streams.data(), streams.size());
+    double tStreams = 1e30;
+    for (int r = 0; r < 5; ++r)
+        tStreams = min(tStreams, timeMs([&] { ok = decodeStreams(table, streams.data(), sbytes, c.size(), c.data()) && ok; }));
+    double mbOut = text.size() / 1048576.0;
+    cout << "Decode " << mb << " MB of text (max code " << table.maxLen << " bits, "
+         << table.entries.size() << " table entries)\n";
+    cout << "  tree walk:   " << mbOut / tWalk * 1000 << " MB/s\n";
+    cout << "  table:       " << mbOut / tTable * 1000 << " MB/s\n";
+    cout << "  " << STREAMS << " streams:   " << mbOut / tStreams * 1000 << " MB/s ("
+         << sbytes - (bits + 7) / 8 << " bytes more)\n";
+    cout << "  round trip:  " << (ok && memcmp(a.data(), text.data(), a.size()) == 0 &&
+                                  memcmp(b.data(), text.data(), b.size()) == 0 &&
+                                  memcmp(c.data(), text.data(), c.size()) == 0 ? "yes" : "NO") << "\n";
+}
+
+// Round trips random inputs of assorted shapes (uniform, skewed, one symbol,
+// empty, Fibonacci counts for codes long enough to need nested tables), then
+// checks that corrupted or truncated streams are rejected or at least stay
+// in bounds; the same again as interleaved streams, through the
+// length-limited canonical container and through the adaptive coder, its
+// stream fed in random-sized chunks.
+// Returns false on the first mismatch.
+bool runFuzz(int iterations) {
+    mt19937 rng(99);
+    HuffmanCodec codec, container; // reused for every iteration
+    for (int it = 0; it < iterations; ++it) {
+        int shape = it % 6;
+        size_t n = shape == 3 ? 0 : rng() % 20000;
+        string s(n, '\0');
+        if (shape == 5) {
+            // data whose own counts are Fibonacci: tree depth m - 1, up to 23
+            int m = 2 + (int)(rng() % 23);
+            s.clear();
+            long long f1 = 1, f2 = 1;
+            for (int i = 0; i < m; ++i) {
+                s.append((size_t)f1, (char)(rng() % 256));
+                long long t = f1 + f2;
+                f1 = f2;
+                f2 = t;
+            }
+            shuffle(s.begin(), s.end(), rng);
+            n = s.size();
+            codec.buildInitial(s);
+        } else if (shape == 4) {
+            // Fibonacci frequencies over m symbols -> code lengths up to m - 1
+            int m = 2 + (int)(rng() % 49);
+            vector<long long> freq(256, 0);
+            long long f1 = 1, f2 = 1;
+            for (int i = 0; i < m; ++i) {
+                freq[i] = f1;
+                long long t = f1 + f2;
+                f1 = f2;
+                f2 = t;
+            }
+            for (auto &c : s) c = (char)(rng() % m);
+            codec.buildInitialCounts(freq);
+        } else {
+            int k = shape == 2 ? 1 : 1 + (int)(rng() % 256);
+            int base = (int)(rng() % 256);
+            for (auto &c : s) {
+                int v = shape == 1 ? min<int>(k - 1, __builtin_ctz((unsigned)rng() | 0x80000000u)) : (int)(rng() % k);
+                c = (char)((base + v) % 256);
+            }
+            codec.buildInitial(s);
+        }
+        int root = codec.buildHuffmanTree();
+        codec.generateCodes(root);
+        const BitCodes &bitCodes = codec.codes();
+        vector<uint8_t> packed(encodeBound(bitCodes, n));
+        long long bits = encodeBits(bitCodes, (const uint8_t *)s.data(), n, packed.data(), packed.size());
+        DecodeTable table;
+        vector<uint8_t> back(n + 1);
+        if (bits < 0 || !buildDecodeTable(bitCodes, table) ||
+            !decodeBits(table, packed.data(), (bits + 7) / 8, n, back.data()) ||
+            memcmp(back.data(), s.data(), n) != 0) {
+            cout << "round trip failed: iteration " << it << ", shape " << shape << ", " << n << " bytes\n";
+            return false;
+        }
+        size_t bytes = (bits + 7) / 8;
+        if (bytes > 0 && decodeBits(table, packed.data(), bytes - 1, n, back.data())) {
+            cout << "truncated stream accepted: iteration " << it << "\n";
+            return false;
+        }
+        for (int flips = 0; flips < 4 && bytes > 0; ++flips) packed[rng() % bytes] ^= (uint8_t)(1 << (rng() % 8));
+        decodeBits(table, packed.data(), bytes, n, back.data()); // must stay in bounds
+
+        // a byte with no code must be refused, not written as zero bits
+        int absent = 0;
+        while (absent < 256 && bitCodes.len[absent]) absent++;
+        if (absent < 256 && n > 0) {
+            string t = s;
+            t[rng() % n] = (char)absent;
+            if (encodeBits(bitCodes, (const uint8_t *)t.data(), n, packed.data(), packed.size()) != -1) {
+                cout << "uncoded byte accepted: iteration " << it << "\n";
+                return false;
+            }
+        }
+
+        vector<uint8_t> streams(encodeStreamsBound(bitCodes, n));
+        long long sbytes = encodeStreams(bitCodes, (const uint8_t *)s.data(), n, streams.data(), streams.size());
+        if (sbytes < 0 || !decodeStreams(table, streams.data(), sbytes, n, back.data()) ||
+            memcmp(back.data(), s.data(), n) != 0) {
+            cout << "interleaved round trip failed: iteration " << it << ", shape " << shape << ", " << n << " bytes\n";
+            return false;
+        }
+        for (int flips = 0; flips < 4; ++flips) streams[rng() % sbytes] ^= (uint8_t)(1 << (rng() % 8));
+        decodeStreams(table, streams.data(), sbytes, n, back.data());
+
+        vector<uint8_t> msg, out;
+        container.compress((const uint8_t *)s.data(), n, msg);
+        if (container.codes().maxLen > MAXCODELEN || !container.decompress(msg.data(), msg.size(), out) ||
+            out != vector<uint8_t>(s.begin(), s.end())) {
+            cout << "container round trip failed: iteration " << it << ", shape " << shape << "\n";
+            return false;
+        }
+        for (int flips = 0; flips < 4; ++flips) msg[rng() % msg.size()] ^= (uint8_t)(1 << (rng() % 8));
+        container.decompress(msg.data(), msg.size(), out);
+
+        AdaptiveEncoder enc;
+        for (char c : s) enc.put((uint8_t)c);
+        enc.finish();
+        msg = enc.out();
+        AdaptiveDecoder dec;
+        out.clear();
+        bool fed = true;
+        for (size_t at = 0; at < msg.size() && fed;) {
+            size_t len = min<size_t>(msg.size() - at, 1 + rng() % 64);
+            fed = dec.feed(msg.data() + at, len, out) && dec.tree().valid();
+            at += len;
+        }
+        if (!fed || !dec.done() || out != vector<uint8_t>(s.begin(), s.end())) {
+            cout << "adaptive round trip failed: iteration " << it << ", shape " << shape << "\n";
+            return false;
+        }
+        for (int flips = 0; flips < 4; ++flips) msg[rng() % msg.size()] ^= (uint8_t)(1 << (rng() % 8));
+        AdaptiveDecoder bad;
+        out.clear();
+        bad.feed(msg.data(), msg.size(), out);
+    }
+    cout << "fuzz: " << iterations << " round trips ok\n";
+    return true;
 }
 
-void generateCodes(int root) {
-    for (int i = 0; i < 256; ++i) codeTable[i].clear();
-    buildCodesRec(root, "");
+// Histogram kernels on random, skewed and single-byte data
+void runHistogramBenchmark(int mb, int threads) {
+    size_t n = (size_t)mb << 20;
+    mt19937_64 rng(21);
+    vector<uint8_t> random(n), skewed(n), constant(n, 'a');
+    for (size_t i = 0; i < n; i += 8) {
+        uint64_t v = rng();
+        memcpy(&random[i], &v, min<size_t>(8, n - i));
+    }
+    // ~90% one byte, the rest from a handful, in runs
+    for (size_t i = 0; i < n; ++i) skewed[i] = rng() % 10 ? 'e' : (uint8_t)('a' + rng() % 6);
+    cout << "Byte histogram, " << mb << " MB\n";
+    for (auto &data : {make_pair("random", &random), make_pair("skewed", &skewed), make_pair("constant", &constant)}) {
+        const vector<uint8_t> &v = *data.second;
+        long long a[256] = {0}, b[256] = {0}, c[256] = {0};
+        auto gbps = [&](double ms) { return n / ms / 1e6; };
+        double tNaive = timeMs([&] { for (uint8_t x : v) a[x]++; });
+        double tBanked = timeMs([&] { byteHistogram(v.data(), n, b); });
+        double tPar = timeMs([&] { byteHistogramParallel(v.data(), n, c, threads); });
+        bool same = equal(a, a + 256, b) && equal(a, a + 256, c);
+        cout << "  " << setw(8) << data.first << ": single loop " << gbps(tNaive) << " GB/s, 4 banks "
+             << gbps(tBanked) << " GB/s, " << threads << " threads " << gbps(tPar) << " GB/s"
+             << (same ? "" : "  MISMATCH") << "\n";
+    }
 }
 
-string encodeString(const string &s) {
-    string out;
-    for (unsigned char c : s) {
-        out += codeTable[c];
+// Many small independent messages, one codec per worker thread, reused
+// across messages vs constructed per message
+void runMessageBenchmark(int count, int threads) {
+    const size_t MSG = 4096;
+    string text = makeTextCorpus(MSG * 64, 12);
+    cout << count << " messages of " << MSG << " bytes on " << threads << " threads\n";
+    for (int reuse = 1; reuse >= 0; --reuse) {
+        atomic<int> bad{0};
+        double ms = timeMs([&] {
+            vector<thread> pool;
+            for (int t = 0; t < threads; ++t)
+                pool.emplace_back([&, t] {
+                    HuffmanCodec mine;
+                    vector<uint8_t> msg, back;
+                    for (int i = t; i < count; i += threads) {
+                        const uint8_t *src = (const uint8_t *)text.data() + (i % 64) * MSG;
+                        if (reuse) {
+                            mine.compress(src, MSG, msg);
+                            if (!mine.decompress(msg.data(), msg.size(), back)) bad++;
+                        } else {
+                            HuffmanCodec fresh;
+                            fresh.compress(src, MSG, msg);
+                            if (!fresh.decompress(msg.data(), msg.size(), back)) bad++;
+                        }
+                        if (back.size() != MSG || memcmp(back.data(), src, MSG) != 0) bad++;
+                    }
+                });
+            for (auto &th : pool) th.join();
+        });
+        cout << "  " << (reuse ? "codec reused:    " : "codec per message:") << " " << count / ms * 1000
+             << " round trips/s" << (bad ? "  ERRORS" : "") << "\n";
+    }
+}
+
+// Compress + decompress a temp file of text at 1 thread and at `threads`
+void runFileBenchmark(int mb, int threads) {
+    string dir = filesystem::temp_directory_path().string();
+    string raw = dir + "/huf_bench.txt", packed = dir + "/huf_bench.huf", back = dir + "/huf_bench.out";
+    {
+        string text = makeTextCorpus((size_t)mb << 20, 8);
+        ofstream(raw, ios::binary).write(text.data(), text.size());
+    }
+    cout << "File round trip, " << mb << " MB of text, " << DEFAULT_BLOCK / 1024 << " KB blocks\n";
+    for (int t : {1, threads}) {
+        bool ok = true;
+        double tc = timeMs([&] { ok = compressFile(raw, packed, t) && ok; });
+        double td = timeMs([&] { ok = decompressFile(packed, back, t) && ok; });
+        ifstream a(raw, ios::binary), b(back, ios::binary);
+        ok = ok && equal(istreambuf_iterator<char>(a), istreambuf_iterator<char>(),
+                         istreambuf_iterator<char>(b), istreambuf_iterator<char>());
+        cout << "  " << setw(2) << t << " threads: compress " << mb / tc * 1000 << " MB/s, decompress "
+             << mb / td * 1000 << " MB/s, ratio " << (double)filesystem::file_size(packed) / filesystem::file_size(raw)
+             << ", round trip " << (ok ? "ok" : "FAILED") << "\n";
+    }
+    vector<uint8_t> block;
+    size_t last = ((size_t)mb << 20) / DEFAULT_BLOCK - 1;
+    double tx = timeMs([&] { extractBlock(packed, last, block); });
+    cout << "  random access to block " << last << ": " << tx << " ms\n";
+    remove(raw.c_str());
+    remove(packed.c_str());
+    remove(back.c_str());
+}
+
+// One-pass adaptive coder vs the two-pass static container on the same text
+void runAdaptiveBenchmark(int mb) {
+    string text = makeTextCorpus((size_t)mb << 20, 5);
+    double mbIn = text.size() / 1048576.0;
+    AdaptiveEncoder enc;
+    double tEnc = timeMs([&] {
+        for (char c : text) enc.put((uint8_t)c);
+        enc.finish();
+    });
+    vector<uint8_t> packed = enc.out(), back;
+    back.reserve(text.size());
+    AdaptiveDecoder dec;
+    bool ok = true;
+    double tDec = timeMs([&] { ok = dec.feed(packed.data(), packed.size(), back) && dec.done(); });
+    HuffmanCodec codec;
+    vector<uint8_t> msg;
+    double tStatic = timeMs([&] { codec.compress((const uint8_t *)text.data(), text.size(), msg); });
+    cout << "Adaptive Huffman, " << mb << " MB of text\n";
+    cout << "  encode:      " << mbIn / tEnc * 1000 << " MB/s\n";
+    cout << "  decode:      " << mbIn / tDec * 1000 << " MB/s\n";
+    cout << "  static:      " << mbIn / tStatic * 1000 << " MB/s (two passes)\n";
+    cout << "  size:        " << packed.size() << " bytes adaptive, " << msg.size() << " static ("
+         << 100.0 * packed.size() / msg.size() << "%)\n";
+    cout << "  round trip:  " << (ok && back == vector<uint8_t>(text.begin(), text.end()) ? "yes" : "NO") << "\n";
+}
+
+// Peak resident set of the process so far, in KB (0 where unsupported)
+long peakRssKB() {
+#ifndef _WIN32
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+// Corpus for --suite: "text", "binary" (fixed-size records of counters,
+// small ints and doubles), "skewed" (~90% one byte) or "random"
+vector<uint8_t> makeCorpus(const string &kind, size_t n, unsigned seed) {
+    vector<uint8_t> v(n);
+    mt19937_64 rng(seed);
+    if (kind == "text") {
+        string t = makeTextCorpus(n, seed);
+        memcpy(v.data(), t.data(), n);
+    } else if (kind == "binary") {
+        uint32_t id = 1000;
+        for (size_t i = 0; i < n; i += 16) {
+            uint8_t rec[16];
+            uint32_t small = (uint32_t)(rng() % 100);
+            double value = (double)(rng() % 10000) / 100;
+            id += 1 + (uint32_t)(rng() % 3);
+            memcpy(rec, &id, 4);
+            memcpy(rec + 4, &small, 4);
+            memcpy(rec + 8, &value, 8);
+            memcpy(&v[i], rec, min<size_t>(16, n - i));
+        }
+    } else if (kind == "skewed") {
+        for (auto &b : v) b = rng() % 10 ? 'e' : (uint8_t)('a' + rng() % 6);
+    } else {
+        for (size_t i = 0; i < n; i += 8) {
+            uint64_t x = rng();
+            memcpy(&v[i], &x, min<size_t>(8, n - i));
+        }
+    }
+    return v;
+}
+
+// Every corpus kind at 1 KB, 64 KB, 1 MB, 16 MB, 256 MB and 1 GB, up to
+// maxMB. One CSV row per case: tree build (histogram, tree, canonical
+// codes), interleaved encode and decode throughput, output bits per byte
+// against the order-0 entropy, and the peak RSS so far (a high-water mark,
+// so sizes run smallest first). Small cases repeat and keep the best time.
+void runSuite(int maxMB) {
+    const size_t sizes[] = {(size_t)1 << 10, (size_t)64 << 10, (size_t)1 << 20,
+                            (size_t)16 << 20, (size_t)256 << 20, (size_t)1 << 30};
+    cout << "corpus,bytes,build_ms,encode_mb_s,decode_mb_s,bits_per_byte,entropy_bits_per_byte,ratio_vs_entropy,peak_rss_kb,ok\n";
+    cout << fixed << setprecision(4);
+    for (size_t n : sizes) {
+        if (n > ((size_t)max(maxMB, 0) << 20) && n > 1024) break;
+        for (const string kind : {"text", "binary", "skewed", "random"}) {
+            vector<uint8_t> data = makeCorpus(kind, n, 31);
+            int reps = (int)max<size_t>(1, min<size_t>(1000, ((size_t)16 << 20) / n));
+            HuffmanCodec codec;
+            long long freq[256];
+            double tBuild = 1e30, tEnc = 1e30, tDec = 1e30;
+            for (int r = 0; r < reps; ++r) {
+                tBuild = min(tBuild, timeMs([&] {
+                    fill(freq, freq + 256, 0);
+                    byteHistogram(data.data(), n, freq);
+                    codec.buildInitialCounts(freq, 256);
+                    codec.generateCanonicalCodes(codec.buildHuffmanTree());
+                }));
+            }
+            const BitCodes &codes = codec.codes();
+            vector<uint8_t> packed(encodeStreamsBound(codes, n)), back(n);
+            long long bytes = 0;
+            for (int r = 0; r < reps; ++r)
+                tEnc = min(tEnc, timeMs([&] { bytes = encodeStreams(codes, data.data(), n, packed.data(), packed.size()); }));
+            DecodeTable table;
+            bool ok = true;
+            for (int r = 0; r < reps; ++r)
+                tDec = min(tDec, timeMs([&] {
+                    ok = buildDecodeTable(codes, table) && decodeStreams(table, packed.data(), bytes, n, back.data());
+                }));
+            ok = ok && back == data;
+            double entropy = 0;
+            for (int c = 0; c < 256; ++c)
+                if (freq[c]) entropy -= (double)freq[c] / n * log2((double)freq[c] / n);
+            uint8_t header[130];
+            double bpb = (bytes + writeLengthHeader(codes, header)) * 8.0 / n;
+            double mb = n / 1048576.0;
+            cout << kind << "," << n << "," << tBuild << "," << mb / tEnc * 1000 << "," << mb / tDec * 1000 << ","
+                 << bpb << "," << entropy << "," << (entropy > 0 ? bpb / entropy : 0) << "," << peakRssKB() << ","
+                 << (ok ? 1 : 0) << "\n";
+        }
     }
-    return out;
 }
 
 // Demo
-int main() {
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runTreeBenchmark();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--encode-bench") {
+        runEncodeBenchmark(argc > 2 ? atoi(argv[2]) : 64);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--decode-bench") {
+        runDecodeBenchmark(argc > 2 ? atoi(argv[2]) : 64);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--fuzz") {
+        return runFuzz(argc > 2 ? atoi(argv[2]) : 2000) ? 0 : 1;
+    }
+    if (argc > 1 && string(argv[1]) == "--adaptive-bench") {
+        runAdaptiveBenchmark(argc > 2 ? atoi(argv[2]) : 32);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--suite") {
+        runSuite(argc > 2 ? atoi(argv[2]) : 64);
+        return 0;
+    }
+    int cores = (int)max(1u, thread::hardware_concurrency());
+    if (argc > 1 && string(argv[1]) == "--hist-bench") {
+        runHistogramBenchmark(argc > 2 ? atoi(argv[2]) : 512, argc > 3 ? atoi(argv[3]) : cores);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--messages") {
+        runMessageBenchmark(argc > 2 ? atoi(argv[2]) : 200000, argc > 3 ? atoi(argv[3]) : cores);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--file-bench") {
+        runFileBenchmark(argc > 2 ? atoi(argv[2]) : 256, argc > 3 ? atoi(argv[3]) : cores);
+        return 0;
+    }
+    // file tool: --compress in out [threads] [blockKB], --decompress in out
+    // [threads], --extract in block out ("-" = stdin/stdout)
+    if (argc > 3 && string(argv[1]) == "--compress") {
+        uint32_t block = argc > 5 ? (uint32_t)atoi(argv[5]) * 1024 : DEFAULT_BLOCK;
+        if (compressFile(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : cores, block)) return 0;
+        cerr << "compression failed\n";
+        return 1;
+    }
+    if (argc > 3 && string(argv[1]) == "--decompress") {
+        if (decompressFile(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : cores)) return 0;
+        cerr << "not a valid container, or a block is corrupt\n";
+        return 1;
+    }
+    // stream tool: --adaptive-encode / --adaptive-decode, stdin to stdout
+    if (argc > 1 && string(argv[1]) == "--adaptive-encode") {
+        return adaptiveEncodeStream(stdin, stdout) ? 0 : 1;
+    }
+    if (argc > 1 && string(argv[1]) == "--adaptive-decode") {
+        if (adaptiveDecodeStream(stdin, stdout)) return 0;
+        cerr << "malformed or truncated adaptive stream\n";
+        return 1;
+    }
+    if (argc > 4 && string(argv[1]) == "--extract") {
+        vector<uint8_t> raw;
+        if (!extractBlock(argv[2], (size_t)atoll(argv[3]), raw)) {
+            cerr << "no such block, or it is corrupt\n";
+            return 1;
+        }
+        FILE *out = string(argv[4]) == "-" ? stdout : fopen(argv[4], "wb");
+        if (!out) return 1;
+        fwrite(raw.data(), 1, raw.size(), out);
+        return fclose(out) == 0 ? 0 : 1;
+    }
     string input;
     cout << "Enter input string to compress: ";
     getline(cin, input);
-    buildInitial(input);
-    int root = buildHuffmanTree();
-    generateCodes(root);
+    HuffmanCodec codec;
+    codec.buildInitial(input);
+    int root = codec.buildHuffmanTree();
+    codec.generateCodes(root);
     cout << "Codes generated (for chars present):\n";
     for (int i = 0; i < 256; ++i) {
-        if (!codeTable[i].empty()) {
+        if (!codec.code(i).empty()) {
             if (isprint(i)) cout << (char)i << " : ";
             else cout << int(i) << " : ";
-            cout << codeTable[i] << "\n";
+            cout << codec.code(i) << "\n";
         }
     }
-    string compressed = encodeString(input);
+    string compressed = codec.encodeString(input);
     cout << "Compressed bit stream:\n" << compressed << "\n";
+    const BitCodes &bitCodes = codec.codes();
+    vector<uint8_t> packed(encodeBound(bitCodes, input.size()));
+    long long bits = encodeBits(bitCodes, (const uint8_t *)input.data(), input.size(), packed.data(), packed.size());
+    DecodeTable table;
+    if (bits >= 0 && buildDecodeTable(bitCodes, table)) {
+        cout << "Packed: " << (bits + 7) / 8 << " bytes (" << bits << " bits) from " << input.size() << " bytes\n";
+        string back(input.size(), '\0');
+        bool ok = decodeBits(table, packed.data(), (bits + 7) / 8, back.size(), (uint8_t *)&back[0]);
+        cout << "Decoded back: " << (ok && back == input ? "matches input" : "MISMATCH") << "\n";
+    }
+    vector<uint8_t> msg, restored;
+    codec.compress((const uint8_t *)input.data(), input.size(), msg);
+    bool same = codec.decompress(msg.data(), msg.size(), restored) &&
+                string(restored.begin(), restored.end()) == input;
+    cout << "Canonical message with length header: " << msg.size() << " bytes, round trip "
+         << (same ? "ok" : "FAILED") << "\n";
     return 0;
 }
@@ -1,29 +1,139 @@
 // Q3_AdaptiveHashMap.cpp
 #include <bits/stdc++.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 using namespace std;
 
+// Bump allocator for a map's entries, nodes and string bytes: requests are
+// carved off the end of the current chunk, nothing is freed one at a time,
+// and release() hands every chunk back at once.
+class Arena : public pmr::memory_resource {
+private:
+    static constexpr size_t CHUNK = (size_t)1 << 20;
+    vector<unique_ptr<char[]>> chunks;
+    char *cur = nullptr, *end = nullptr;
+    size_t reserved = 0, used = 0;
+
+    void *do_allocate(size_t bytes, size_t align) override {
+        char *p = (char *)(((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1));
+        if (!cur || p + bytes > end) {
+            size_t size = max(CHUNK, bytes + align);
+            chunks.emplace_back(new char[size]);
+            cur = chunks.back().get();
+            end = cur + size;
+            reserved += size;
+            p = (char *)(((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1));
+        }
+        cur = p + bytes;
+        used += bytes;
+        return p;
+    }
+    void do_deallocate(void *, size_t, size_t) override {} // reclaimed by release()
+    bool do_is_equal(const pmr::memory_resource &o) const noexcept override { return this == &o; }
+
+public:
+    void release() {
+        chunks.clear();
+        cur = end = nullptr;
+        reserved = used = 0;
+    }
+    size_t bytesReserved() const { return reserved; }
+    size_t bytesUsed() const { return used; }
+};
+
+// Heap allocation through the resource interface, keeping a tally of the
+// bytes live so a heap-backed map can report its size too
+class CountingResource : public pmr::memory_resource {
+private:
+    size_t live = 0;
+
+    void *do_allocate(size_t bytes, size_t align) override {
+        live += bytes;
+        if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) return ::operator new(bytes, align_val_t(align));
+        return ::operator new(bytes);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override {
+        live -= bytes;
+        if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) ::operator delete(p, align_val_t(align));
+        else ::operator delete(p);
+    }
+    bool do_is_equal(const pmr::memory_resource &o) const noexcept override { return this == &o; }
+
+public:
+    size_t bytesLive() const { return live; }
+};
+
+// Key and value live in the map's memory resource (the heap, or an Arena);
+// lists build their entries with it through the allocator constructors
 struct Entry {
-    string key;
-    string value;
+    using allocator_type = pmr::polymorphic_allocator<char>;
+    pmr::string key;
+    pmr::string value;
     Entry() {}
-    Entry(string k, string v) : key(k), value(v) {}
+    explicit Entry(const allocator_type &a) : key(a), value(a) {}
+    Entry(const Entry &o, const allocator_type &a) : key(o.key, a), value(o.value, a) {}
+    Entry(Entry &&o, const allocator_type &a) : key(move(o.key), a), value(move(o.value), a) {}
+    Entry(const Entry &) = default;
+    Entry(Entry &&) = default;
+    Entry &operator=(const Entry &) = default;
+    Entry &operator=(Entry &&) = default;
 };
 
+// Stores s into dst: moved when it is already a string of the same resource,
+// otherwise copied into dst's own
+inline void setString(pmr::string &dst, string_view s) { dst.assign(s.data(), s.size()); }
+inline void setString(pmr::string &dst, pmr::string &&s) { dst = move(s); }
+
 struct TreeNode {
     Entry e;
     TreeNode *l, *r;
-    TreeNode(const Entry &en) : e(en), l(nullptr), r(nullptr) {}
+    int height; // AVL: subtree height, leaves are 1
+    explicit TreeNode(const Entry::allocator_type &a) : e(a), l(nullptr), r(nullptr), height(1) {}
 };
 
+// A bucket is a list until it holds more than `threshold` entries, then an
+// AVL tree until it drops to `untreeify` or fewer. The gap between the two
+// keeps a bucket hovering at the boundary from converting on every call.
 class Bucket {
 public:
     bool isTree;
-    list<Entry> lst; // used when not tree
+    pmr::list<Entry> lst; // used when not tree
     TreeNode *root;  // used when tree
     int count;
     int threshold;
+    int untreeify;
+    pmr::memory_resource *mem; // lists, nodes and strings come from here
 
-    Bucket(int k=5) : isTree(false), root(nullptr), count(0), threshold(k) {}
+    Bucket(int k=5, int u=-1, pmr::memory_resource *m = pmr::get_default_resource())
+        : isTree(false), lst(m), root(nullptr), count(0), threshold(k), untreeify(u < 0 ? k / 2 : min(u, k)), mem(m) {}
+
+    // the tree is owned: buckets move, never copy
+    Bucket(const Bucket &) = delete;
+    Bucket &operator=(const Bucket &) = delete;
+    Bucket(Bucket &&o) noexcept
+        : isTree(o.isTree), lst(move(o.lst)), root(o.root), count(o.count), threshold(o.threshold),
+          untreeify(o.untreeify), mem(o.mem) {
+        o.root = nullptr;
+        o.isTree = false;
+        o.count = 0;
+    }
+    Bucket &operator=(Bucket &&o) noexcept {
+        if (this != &o) {
+            clearTree(root);
+            isTree = o.isTree;
+            lst = move(o.lst);
+            root = o.root;
+            count = o.count;
+            threshold = o.threshold;
+            untreeify = o.untreeify;
+            mem = o.mem;
+            o.root = nullptr;
+            o.isTree = false;
+            o.count = 0;
+        }
+        return *this;
+    }
 
     ~Bucket() {
         clearTree(root);
@@ -32,27 +142,23 @@ public:
         if (!node) return;
         clearTree(node->l);
         clearTree(node->r);
-        delete node;
+        freeNode(node);
     }
-
-    void listInsertOrUpdate(const Entry &en) {
-        for (auto &x : lst) {
-            if (x.key == en.key) {
-                x.value = en.value;
-                return;
-            }
-        }
-        lst.push_back(en);
-        count++;
-        if (!isTree && count > threshold) treeify();
+    TreeNode *newNode() {
+        void *p = mem->allocate(sizeof(TreeNode), alignof(TreeNode));
+        return new (p) TreeNode(Entry::allocator_type(mem));
+    }
+    void freeNode(TreeNode *node) {
+        node->~TreeNode();
+        mem->deallocate(node, sizeof(TreeNode), alignof(TreeNode));
     }
 
-    string listSearch(const string &key) {
-        for (auto &x : lst) if (x.key == key) return x.value;
-        return "";
+    Entry *listFind(string_view key) {
+        for (auto &x : lst) if (x.key == key) return &x;
+        return nullptr;
     }
 
-    bool listDelete(const string &key) {
+    bool listDelete(string_view key) {
         for (auto it = lst.begin(); it != lst.end(); ++it) {
             if (it->key == key) {
                 lst.erase(it);
@@ -67,8 +173,9 @@ public:
     void treeify() {
         if (isTree) return;
         root = nullptr;
+        count = 0; // treeInsert counts the entries again
         for (auto &e : lst) {
-            root = treeInsert(root, e);
+            root = treeInsert(root, move(e));
         }
         lst.clear();
         isTree = true;
@@ -84,138 +191,881 @@ public:
         isTree = false;
     }
 
-    TreeNode* treeInsert(TreeNode* node, const Entry &e) {
+    static int height(TreeNode *n) { return n ? n->height : 0; }
+
+    static TreeNode* rotateRight(TreeNode *n) {
+        TreeNode *l = n->l;
+        n->l = l->r;
+        l->r = n;
+        n->height = 1 + max(height(n->l), height(n->r));
+        l->height = 1 + max(height(l->l), height(l->r));
+        return l;
+    }
+    static TreeNode* rotateLeft(TreeNode *n) {
+        TreeNode *r = n->r;
+        n->r = r->l;
+        r->l = n;
+        n->height = 1 + max(height(n->l), height(n->r));
+        r->height = 1 + max(height(r->l), height(r->r));
+        return r;
+    }
+
+    // restores the AVL balance at n after one of its subtrees changed height
+    // by one; returns the subtree's new root
+    static TreeNode* rebalance(TreeNode *n) {
+        n->height = 1 + max(height(n->l), height(n->r));
+        int bal = height(n->l) - height(n->r);
+        if (bal > 1) {
+            if (height(n->l->l) < height(n->l->r)) n->l = rotateLeft(n->l);
+            return rotateRight(n);
+        }
+        if (bal < -1) {
+            if (height(n->r->r) < height(n->r->l)) n->r = rotateRight(n->r);
+            return rotateLeft(n);
+        }
+        return n;
+    }
+
+    // Finds key below node or adds it with an empty value; `found` gets the
+    // entry. The key is only stored as a string when it is added.
+    template<class K>
+    TreeNode* treeFindOrAdd(TreeNode* node, K &&key, Entry *&found, bool &inserted) {
         if (!node) {
             count++;
-            return new TreeNode(e);
+            inserted = true;
+            node = newNode();
+            setString(node->e.key, std::forward<K>(key));
+            found = &node->e;
+            return node;
+        }
+        int c = string_view(key).compare(node->e.key);
+        if (c == 0) {
+            found = &node->e;
+            return node;
         }
-        if (e.key < node->e.key) node->l = treeInsert(node->l, e);
-        else if (e.key > node->e.key) node->r = treeInsert(node->r, e);
-        else node->e.value = e.value; // update
+        if (c < 0) node->l = treeFindOrAdd(node->l, std::forward<K>(key), found, inserted);
+        else node->r = treeFindOrAdd(node->r, std::forward<K>(key), found, inserted);
+        return rebalance(node);
+    }
+
+    TreeNode* treeInsert(TreeNode* node, Entry &&e) {
+        Entry *found;
+        bool inserted = false;
+        node = treeFindOrAdd(node, move(e.key), found, inserted);
+        setString(found->value, move(e.value)); // update, or fill in the new entry
         return node;
     }
 
-    string treeSearch(const string &key) {
+    Entry *treeFind(string_view key) {
         TreeNode *cur = root;
         while (cur) {
-            if (key == cur->e.key) return cur->e.value;
-            if (key < cur->e.key) cur = cur->l;
-            else cur = cur->r;
+            int c = key.compare(cur->e.key);
+            if (c == 0) return &cur->e;
+            cur = c < 0 ? cur->l : cur->r;
+        }
+        return nullptr;
+    }
+
+    Entry *find(string_view key) { return isTree ? treeFind(key) : listFind(key); }
+
+    // Entry for key, added with an empty value if absent (inserted = true);
+    // a list that would go over threshold becomes a tree first
+    template<class K>
+    Entry *findOrAdd(K &&key, bool &inserted) {
+        inserted = false;
+        if (!isTree) {
+            if (Entry *e = listFind(key)) return e;
+            if (count < threshold) {
+                lst.emplace_back();
+                setString(lst.back().key, std::forward<K>(key));
+                count++;
+                inserted = true;
+                return &lst.back();
+            }
+            treeify();
         }
-        return "";
+        Entry *found;
+        root = treeFindOrAdd(root, std::forward<K>(key), found, inserted);
+        return found;
     }
 
-    bool treeDelete(const string &key) {
+    bool treeDelete(string_view key) {
         bool deleted = false;
         root = treeRemove(root, key, deleted);
         if (deleted) count--;
         return deleted;
     }
 
-    TreeNode* treeRemove(TreeNode* node, const string &key, bool &deleted) {
+    TreeNode* treeRemove(TreeNode* node, string_view key, bool &deleted) {
         if (!node) return nullptr;
-        if (key < node->e.key) node->l = treeRemove(node->l, key, deleted);
-        else if (key > node->e.key) node->r = treeRemove(node->r, key, deleted);
+        int c = key.compare(node->e.key);
+        if (c < 0) node->l = treeRemove(node->l, key, deleted);
+        else if (c > 0) node->r = treeRemove(node->r, key, deleted);
         else {
             deleted = true;
             // remove this node
             if (!node->l) {
                 TreeNode* r = node->r;
-                delete node;
+                freeNode(node);
                 return r;
             } else if (!node->r) {
                 TreeNode* l = node->l;
-                delete node;
+                freeNode(node);
                 return l;
             } else {
-                // two children: find inorder successor
-                TreeNode *succ = node->r;
-                while (succ->l) succ = succ->l;
-                node->e = succ->e;
-                node->r = treeRemove(node->r, succ->e.key, deleted);
-                // 'deleted' remains true
+                // two children: the inorder successor is unlinked and takes
+                // node's place, so no key or value is copied
+                TreeNode *succ;
+                TreeNode *r = detachMin(node->r, succ);
+                succ->l = node->l;
+                succ->r = r;
+                freeNode(node);
+                node = succ;
             }
         }
-        return node;
+        return rebalance(node);
+    }
+
+    // unlinks the leftmost node below node into `min`; returns what is left
+    static TreeNode* detachMin(TreeNode *node, TreeNode *&min) {
+        if (!node->l) {
+            min = node;
+            return node->r;
+        }
+        node->l = detachMin(node->l, min);
+        return rebalance(node);
     }
 
-    void inorderToList(TreeNode* node, list<Entry> &out) {
+    void inorderToList(TreeNode* node, pmr::list<Entry> &out) {
         if (!node) return;
         inorderToList(node->l, out);
-        out.push_back(node->e);
+        out.push_back(move(node->e));
         inorderToList(node->r, out);
     }
 };
 
+// simple polynomial hash
+unsigned long long hashBytes(string_view s) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (char c : s) h = (h * 1099511628211ULL) ^ (unsigned char)c;
+    return h;
+}
+
+// Buckets in fixed-size segments, so a table can be built and freed a
+// segment at a time rather than in one large allocation
+class BucketTable {
+private:
+    static const int SEGMENT_BITS = 12;
+    static const size_t SEGMENT = (size_t)1 << SEGMENT_BITS;
+    vector<vector<Bucket>> segments;
+    size_t count = 0;
+    size_t freed = 0; // segments released so far
+
+public:
+    BucketTable() {}
+    BucketTable(size_t n, int threshold, int untreeify, pmr::memory_resource *mem) {
+        for (size_t i = 0; i < n; ++i) push(threshold, untreeify, mem);
+    }
+
+    Bucket &operator[](size_t i) { return segments[i >> SEGMENT_BITS][i & (SEGMENT - 1)]; }
+    size_t size() const { return count; }
+    size_t live() const { return count - min(count, freed << SEGMENT_BITS); } // not released yet
+    bool empty() const { return count == 0; }
+
+    void push(int threshold, int untreeify, pmr::memory_resource *mem) {
+        if (count % SEGMENT == 0) {
+            segments.emplace_back();
+            segments.back().reserve(SEGMENT); // never reallocates after this
+        }
+        segments.back().emplace_back(threshold, untreeify, mem);
+        count++;
+    }
+    // frees the segments wholly below bucket i
+    void release(size_t i) {
+        for (; freed < i >> SEGMENT_BITS && freed < segments.size(); ++freed)
+            vector<Bucket>().swap(segments[freed]);
+    }
+    void clear() {
+        vector<vector<Bucket>>().swap(segments);
+        count = freed = 0;
+    }
+    void swap(BucketTable &o) {
+        segments.swap(o.segments);
+        std::swap(count, o.count);
+        std::swap(freed, o.freed);
+    }
+};
+
+// Mixes the polynomial hash, whose high bits are weak
+unsigned long long mixHash(unsigned long long h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Grows by doubling once entries pass maxLoad per bucket. The resize is
+// incremental: the old table stays alive and every operation moves
+// migrateStep of its buckets across, so no single call pays for rehashing
+// the whole map. A key's bucket is its hash scaled to the table size
+// (h * capacity / 2^64), so old bucket j splits into new buckets 2j and
+// 2j + 1 exactly; moving the old buckets in order therefore builds the new
+// table front to back, and the old one is freed behind it, a segment at a
+// time. While a resize is under way, keys of old buckets not moved yet are read
+// and written in the old table.
 class AdaptiveHashMap {
 private:
+    CountingResource heap;
+    unique_ptr<Arena> arena;  // set in arena mode
+    pmr::memory_resource *mem; // heap or arena: entries, nodes, strings
     int capacity;
+    int initialCapacity;
     int threshold;
-    vector<Bucket> buckets;
+    int untreeify;
+    BucketTable buckets; // while resizing, only [0, 2 * migrated) exist
+    double maxLoad;
+    size_t entries = 0;
+    BucketTable old;     // draining during a resize, else empty
+    int oldCapacity = 0;
+    int migrated = 0;   // old buckets [0, migrated) have moved
+    int migrateStep = 4; // 0: move the whole table at once
+
+    static int index(unsigned long long h, int cap) {
+        return (int)((unsigned __int128)h * (unsigned)cap >> 64);
+    }
+    int hashKey(string_view s) {
+        return index(mixHash(hashBytes(s)), capacity);
+    }
+
+    Bucket &bucketFor(string_view key) {
+        unsigned long long h = mixHash(hashBytes(key));
+        if (!old.empty()) {
+            int j = index(h, oldCapacity);
+            if (j >= migrated) return old[j];
+        }
+        return buckets[index(h, capacity)];
+    }
 
-    int hashKey(const string &s) {
-        // simple polynomial hash -> index
-        unsigned long long h = 1469598103934665603ULL;
-        for (char c : s) h = (h * 1099511628211ULL) ^ (unsigned char)c;
-        return (int)(h % capacity);
+    // splits old bucket `migrated` into the two new buckets after the last;
+    // list nodes are spliced across, not copied
+    void migrateNext() {
+        Bucket &from = old[migrated++];
+        from.listify();
+        buckets.push(threshold, untreeify, mem);
+        buckets.push(threshold, untreeify, mem);
+        while (!from.lst.empty()) {
+            Bucket &to = buckets[hashKey(from.lst.front().key)];
+            to.lst.splice(to.lst.end(), from.lst, from.lst.begin());
+            to.count++;
+        }
+        from.count = 0;
+        for (size_t i = buckets.size() - 2; i < buckets.size(); ++i)
+            if (buckets[i].count > threshold) buckets[i].treeify();
+    }
+
+    void advance() {
+        if (old.empty()) return;
+        int stop = migrateStep ? min(oldCapacity, migrated + migrateStep) : oldCapacity;
+        while (migrated < stop) migrateNext();
+        old.release(migrated);
+        if (migrated == oldCapacity) {
+            old.clear();
+            oldCapacity = 0;
+        }
+    }
+
+    void grow() {
+        // still draining the last resize: finish it first
+        while (migrated < oldCapacity) migrateNext();
+        old.clear();
+        old.swap(buckets);
+        oldCapacity = capacity;
+        capacity *= 2;
+        migrated = 0;
     }
 
 public:
-    AdaptiveHashMap(int cap, int k) : capacity(cap), threshold(k), buckets(cap) {
-        for (int i = 0; i < cap; ++i) buckets[i] = Bucket(k);
+    // k: a bucket becomes a tree above k entries; u: back to a list at u or
+    // fewer (default k / 2)
+    // useArena: keys, values and nodes are bump-allocated from an arena and
+    // only given back by clear() (or when the map goes), so removes and
+    // overwrites leave their old bytes behind until then
+    AdaptiveHashMap(int cap, int k, double maxLoad = 1.0, int u = -1, bool useArena = false)
+        : arena(useArena ? new Arena : nullptr), mem(arena ? (pmr::memory_resource *)arena.get() : &heap),
+          capacity(max(cap, 1)), initialCapacity(capacity), threshold(k), untreeify(Bucket(k, u).untreeify),
+          buckets(capacity, k, untreeify, mem), maxLoad(maxLoad) {}
+
+    // buckets point at the map's own resource
+    AdaptiveHashMap(const AdaptiveHashMap &) = delete;
+    AdaptiveHashMap &operator=(const AdaptiveHashMap &) = delete;
+
+    // buckets moved per operation while resizing; 0 = stop-the-world rehash
+    void setMigrateStep(int step) { migrateStep = max(step, 0); }
+
+    // Sets key to value, or only adds it (assign = false). Key and value
+    // are copied or moved in as passed; an existing key is never copied.
+    template<class K, class V>
+    bool put(K &&key, V &&value, bool assign) {
+        advance();
+        bool inserted;
+        Entry *e = bucketFor(key).findOrAdd(std::forward<K>(key), inserted);
+        if (inserted || assign) setString(e->value, std::forward<V>(value));
+        if (inserted && ++entries > capacity * maxLoad) {
+            grow();
+            if (!migrateStep) advance();
+        }
+        return inserted;
     }
 
     void insert(const string &key, const string &value) {
-        int idx = hashKey(key);
-        Bucket &b = buckets[idx];
-        if (b.isTree) {
-            // insert/update in tree
-            b.treeInsert(b.root, Entry(key, value));
-        } else {
-            // list mode
-            // if exists update, else push
-            bool found = false;
-            for (auto &e : b.lst) {
-                if (e.key == key) {
-                    e.value = value;
-                    found = true; break;
-                }
-            }
-            if (!found) {
-                b.lst.emplace_back(key, value);
-                b.count++;
-                if (b.count > threshold) b.treeify();
-            }
-        }
+        put(key, value, true);
     }
 
+    // Sets key to value, adding it if absent; true if it was added. The
+    // strings are copied into the map's resource; pmr::string rvalues of
+    // that resource are moved in.
+    template<class K, class V>
+    bool insert_or_assign(K &&key, V &&value) {
+        return put(std::forward<K>(key), std::forward<V>(value), true);
+    }
+
+    // Adds key only if absent, leaving an existing value alone; true if it
+    // was added
+    template<class K, class V>
+    bool try_emplace(K &&key, V &&value) {
+        return put(std::forward<K>(key), std::forward<V>(value), false);
+    }
+
+    // Pointer to key's value, or nullptr: no copy, no allocation. Valid
+    // until the next call on the map, which may move entries while resizing.
+    pmr::string *find(string_view key) {
+        advance();
+        Entry *e = bucketFor(key).find(key);
+        return e ? &e->value : nullptr;
+    }
+
+    // Copy of key's value, "" if absent
     string search(const string &key) {
-        int idx = hashKey(key);
-        Bucket &b = buckets[idx];
-        if (b.isTree) return b.treeSearch(key);
-        else return b.listSearch(key);
+        pmr::string *v = find(key);
+        return v ? string(*v) : "";
     }
 
-    void remove(const string &key) {
-        int idx = hashKey(key);
-        Bucket &b = buckets[idx];
+    void remove(string_view key) {
+        advance();
+        Bucket &b = bucketFor(key);
         bool deleted = false;
         if (b.isTree) {
             deleted = b.treeDelete(key);
-            if (deleted && b.count <= threshold) {
+            if (deleted && b.count <= untreeify) {
                 b.listify();
             }
         } else {
             deleted = b.listDelete(key);
-            if (deleted && b.count > threshold && b.count <= threshold) {
-                // not applicable
+        }
+        if (deleted) entries--;
+    }
+
+    // Drops every entry and goes back to the starting table size. With an
+    // arena, the buckets are torn down first and then its chunks are freed
+    // in one go.
+    void clear() {
+        old.clear();
+        buckets.clear();
+        if (arena) arena->release();
+        capacity = initialCapacity;
+        buckets = BucketTable(capacity, threshold, untreeify, mem);
+        entries = 0;
+        oldCapacity = migrated = 0;
+    }
+
+    size_t size() const { return entries; }
+    int bucketCount() const { return capacity; }
+
+    // Bytes held for the entries: arena chunks, or live heap requests (not
+    // counting malloc's own headers), plus the bucket tables
+    size_t memoryBytes() const {
+        size_t tables = (buckets.live() + old.live()) * sizeof(Bucket);
+        return (arena ? arena->bytesReserved() : heap.bytesLive()) + tables;
+    }
+    double bytesPerEntry() const { return entries ? (double)memoryBytes() / entries : 0; }
+
+    // bucket of key in a table of cap buckets, for crafting collisions
+    static int bucketOf(const string &key, int cap) { return index(mixHash(hashBytes(key)), cap); }
+
+    // tallest tree bucket (0 if all are lists)
+    int maxTreeHeight() {
+        int h = 0;
+        for (size_t i = 0; i < buckets.size(); ++i) h = max(h, Bucket::height(buckets[i].root));
+        for (size_t i = migrated; i < old.size(); ++i) h = max(h, Bucket::height(old[i].root));
+        return h;
+    }
+};
+
+// Open-addressing engine with the same API as AdaptiveHashMap. Entries sit
+// inline in one slot array, with one control byte per slot alongside:
+// EMPTY, DELETED, or the low 7 bits of the key's hash when full. A lookup
+// compares the 16 control bytes of a group against that fragment at once
+// (SSE2 where available) and only reads the keys of slots that matched.
+// Groups are probed quadratically; the table doubles when live entries and
+// tombstones pass 7/8 of the slots.
+class FlatHashMap {
+private:
+    static constexpr int GROUP = 16;
+    static constexpr int8_t EMPTY = -128;
+    static constexpr int8_t DELETED = -2;
+
+    struct Slot {
+        string key, value;
+    };
+    vector<int8_t> ctrl;
+    vector<Slot> slots;
+    size_t groupMask; // groups - 1, groups a power of two
+    size_t used = 0;
+    size_t tombstones = 0;
+
+    static unsigned long long hashOf(const string &s) { return mixHash(hashBytes(s)); }
+
+    // bit i set where group byte i == b
+    static uint32_t match(const int8_t *g, int8_t b) {
+#ifdef __SSE2__
+        __m128i v = _mm_loadu_si128((const __m128i *)g);
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+#else
+        uint32_t m = 0;
+        for (int i = 0; i < GROUP; ++i) m |= (uint32_t)(g[i] == b) << i;
+        return m;
+#endif
+    }
+    // bit i set where group byte i is EMPTY or DELETED (the sign bit)
+    static uint32_t matchFree(const int8_t *g) {
+#ifdef __SSE2__
+        return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+#else
+        uint32_t m = 0;
+        for (int i = 0; i < GROUP; ++i) m |= (uint32_t)(g[i] < 0) << i;
+        return m;
+#endif
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+    // slot holding key, or -1
+    long findSlot(const string &key, unsigned long long h) const {
+        int8_t frag = (int8_t)(h & 0x7f);
+        size_t g = (h >> 7) & groupMask;
+        for (size_t step = 1;; ++step) {
+            const int8_t *c = &ctrl[g * GROUP];
+            for (uint32_t m = match(c, frag); m; m &= m - 1) {
+                size_t i = g * GROUP + __builtin_ctz(m);
+                if (slots[i].key == key) return (long)i;
             }
+            if (match(c, EMPTY)) return -1;
+            g = (g + step) & groupMask;
+        }
+    }
+
+    // first EMPTY or DELETED slot on key's probe sequence
+    size_t freeSlot(unsigned long long h) const {
+        size_t g = (h >> 7) & groupMask;
+        for (size_t step = 1;; ++step) {
+            uint32_t m = matchFree(&ctrl[g * GROUP]);
+            if (m) return g * GROUP + __builtin_ctz(m);
+            g = (g + step) & groupMask;
+        }
+    }
+
+    void rehash(size_t groups) {
+        vector<int8_t> oldCtrl(groups * GROUP, EMPTY);
+        vector<Slot> oldSlots(groups * GROUP);
+        oldCtrl.swap(ctrl);
+        oldSlots.swap(slots);
+        groupMask = groups - 1;
+        tombstones = 0;
+        for (size_t i = 0; i < oldSlots.size(); ++i) {
+            if (oldCtrl[i] < 0) continue;
+            unsigned long long h = hashOf(oldSlots[i].key);
+            size_t j = freeSlot(h);
+            ctrl[j] = (int8_t)(h & 0x7f);
+            slots[j] = move(oldSlots[i]);
+        }
+    }
+
+public:
+    // cap: expected number of keys; the table grows past it as needed
+    explicit FlatHashMap(size_t cap = 16) {
+        size_t groups = 1;
+        while (groups * GROUP * 7 / 8 < cap) groups *= 2;
+        ctrl.assign(groups * GROUP, EMPTY);
+        slots.resize(groups * GROUP);
+        groupMask = groups - 1;
+    }
+
+    void insert(const string &key, const string &value) {
+        unsigned long long h = hashOf(key);
+        long at = findSlot(key, h);
+        if (at >= 0) {
+            slots[at].value = value;
+            return;
+        }
+        if ((used + tombstones + 1) * 8 > capacity() * 7) {
+            // double if live entries fill half the limit, else just clear
+            // out the tombstones
+            size_t groups = groupMask + 1;
+            rehash((used + 1) * 16 > capacity() * 7 ? groups * 2 : groups);
+        }
+        size_t i = freeSlot(h);
+        if (ctrl[i] == DELETED) tombstones--;
+        ctrl[i] = (int8_t)(h & 0x7f);
+        slots[i].key = key;
+        slots[i].value = value;
+        used++;
+    }
+
+    string search(const string &key) const {
+        long at = findSlot(key, hashOf(key));
+        return at >= 0 ? slots[at].value : "";
+    }
+
+    void remove(const string &key) {
+        long at = findSlot(key, hashOf(key));
+        if (at < 0) return;
+        // A group that still has an EMPTY slot has never been probed past,
+        // so the slot can go back to EMPTY instead of leaving a tombstone
+        const int8_t *g = &ctrl[at / GROUP * GROUP];
+        if (match(g, EMPTY)) {
+            ctrl[at] = EMPTY;
+        } else {
+            ctrl[at] = DELETED;
+            tombstones++;
         }
+        slots[at] = Slot();
+        used--;
     }
+
+    size_t size() const { return used; }
 };
 
+// ----------------------------------------------------------------------
+// Benchmarks and checks (run with --bench [keys], --growth [keys],
+// --collide [keys], --lookups [keys], --arena [keys], --fuzz [operations])
+// ----------------------------------------------------------------------
+// Heap allocations so far, counted by the replacement operator new below
+size_t allocationCount = 0;
+
+void *operator new(size_t n) {
+    allocationCount++;
+    if (void *p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+// out of line, or GCC flags free() on a pointer from operator new
+__attribute__((noinline)) void operator delete(void *p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept { free(p); }
+
+template<class F>
+double timeMs(F f) {
+    auto t0 = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+// Insert n keys, look them all up in random order, look up n absent keys,
+// remove half
+template<class Map>
+void benchMap(const char *name, Map &map, const vector<string> &keys, const vector<string> &missing,
+              const vector<int> &order) {
+    size_t n = keys.size(), found = 0;
+    double tInsert = timeMs([&] { for (size_t i = 0; i < n; ++i) map.insert(keys[i], keys[i]); });
+    double tHit = timeMs([&] { for (int i : order) found += !map.search(keys[i]).empty(); });
+    double tMiss = timeMs([&] { for (int i : order) found += !map.search(missing[i]).empty(); });
+    double tRemove = timeMs([&] { for (size_t i = 0; i < n; i += 2) map.remove(keys[i]); });
+    auto ns = [&](double ms, size_t ops) { return ms * 1e6 / ops; };
+    cout << "  " << left << setw(10) << name << right << fixed << setprecision(1)
+         << setw(9) << ns(tInsert, n) << setw(9) << ns(tHit, n) << setw(9) << ns(tMiss, n)
+         << setw(9) << ns(tRemove, n / 2) << (found == n ? "" : "  WRONG") << "\n";
+}
+
+void runBenchmark(int n) {
+    vector<string> keys(n), missing(n);
+    for (int i = 0; i < n; ++i) {
+        keys[i] = "key" + to_string(i);
+        missing[i] = "nokey" + to_string(i);
+    }
+    vector<int> order(n);
+    iota(order.begin(), order.end(), 0);
+    shuffle(order.begin(), order.end(), mt19937(5));
+    cout << n << " keys, ns per operation\n";
+    cout << "  engine       insert      hit     miss   remove\n";
+    {
+        AdaptiveHashMap chained(n, 5);
+        benchMap("chained", chained, keys, missing, order);
+    }
+    {
+        FlatHashMap flat(n);
+        benchMap("flat", flat, keys, missing, order);
+    }
+    {
+        FlatHashMap grown;
+        benchMap("flat/grow", grown, keys, missing, order);
+    }
+}
+
+// Per-insert latency while a map grows from 16 buckets to n keys, with the
+// incremental resize and with a stop-the-world rehash (FlatHashMap, which
+// rehashes all at once, for reference)
+void runGrowthBenchmark(int n) {
+    vector<string> keys(n);
+    for (int i = 0; i < n; ++i) keys[i] = "key" + to_string(i);
+    vector<double> lat(n);
+    auto run = [&](const char *name, auto &map) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < n; ++i) {
+            auto t0 = chrono::steady_clock::now();
+            map.insert(keys[i], keys[i]);
+            lat[i] = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+        }
+        double total = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        sort(lat.begin(), lat.end());
+        auto pct = [&](double p) { return lat[min<size_t>(n - 1, (size_t)(p * n))] / 1000; };
+        cout << "  " << left << setw(12) << name << right << fixed << setprecision(2) << setw(8) << pct(0.5)
+             << setw(8) << pct(0.99) << setw(9) << pct(0.999) << setw(11) << lat[n - 1] / 1000
+             << setw(10) << setprecision(0) << total << "\n";
+    };
+    cout << n << " inserts from empty, latency in us, total in ms\n";
+    cout << "  map             p50     p99    p99.9        max     total\n";
+    {
+        AdaptiveHashMap m(16, 5);
+        run("incremental", m);
+    }
+    {
+        AdaptiveHashMap m(16, 5);
+        m.setMigrateStep(0);
+        run("full rehash", m);
+    }
+    {
+        FlatHashMap m;
+        run("flat", m);
+    }
+}
+
+// All keys in one bucket: n crafted colliding keys inserted in sorted order
+// (the worst case for an unbalanced tree) and looked up, as a tree bucket
+// and as a plain list; then one bucket bouncing across the treeify
+// threshold, with and without a gap before it turns back into a list
+void runCollisionBenchmark(int n) {
+    const int CAP = 64, K = 8;
+    vector<string> keys;
+    for (long i = 0; (int)keys.size() < n; ++i) {
+        string key = "c" + to_string(i);
+        if (AdaptiveHashMap::bucketOf(key, CAP) == 0) keys.push_back(key);
+    }
+    sort(keys.begin(), keys.end());
+    cout << n << " keys in one bucket, sorted insert, ns per operation\n";
+    cout << "  bucket       insert   search   height\n";
+    for (int k : {K, INT_MAX}) {
+        AdaptiveHashMap map(CAP, k, 1e18);
+        double tInsert = timeMs([&] { for (auto &key : keys) map.insert(key, key); });
+        size_t found = 0;
+        double tSearch = timeMs([&] { for (auto &key : keys) found += map.search(key) == key; });
+        cout << "  " << left << setw(10) << (k == K ? "avl" : "list") << right << fixed << setprecision(1)
+             << setw(9) << tInsert * 1e6 / n << setw(9) << tSearch * 1e6 / n << setw(9) << map.maxTreeHeight()
+             << (found == keys.size() ? "" : "  WRONG") << "\n";
+    }
+    const int FLIPS = 200000;
+    cout << "bucket at " << K << "/" << K + 1 << " entries, " << FLIPS << " remove+insert pairs, ns per pair\n";
+    for (int u : {K, K / 2}) {
+        AdaptiveHashMap map(CAP, K, 1e18, u);
+        for (int i = 0; i <= K; ++i) map.insert(keys[i], keys[i]);
+        double t = timeMs([&] {
+            for (int i = 0; i < FLIPS; ++i) {
+                map.remove(keys[0]);
+                map.insert(keys[0], keys[0]);
+            }
+        });
+        cout << "  untreeify at " << u << ": " << setw(8) << t * 1e6 / FLIPS << (u == K ? "  (no gap)" : "") << "\n";
+    }
+}
+
+// Read-heavy path on n path-like keys (too long for the small-string
+// buffer): heap allocations and ns per call for lookups through search()
+// (a value copy; from a string_view also a key copy) and find(), and for
+// updates of existing keys through insert() and insert_or_assign()
+void runLookupBenchmark(int n) {
+    vector<string> keys(n), values(n);
+    for (int i = 0; i < n; ++i) {
+        keys[i] = "/srv/data/projects/archive/file" + to_string(i) + ".txt";
+        values[i] = "/mnt/storage/volume7/blocks/" + to_string(i);
+    }
+    vector<string_view> views(keys.begin(), keys.end()); // e.g. parsed out of a request
+    vector<int> order(n);
+    iota(order.begin(), order.end(), 0);
+    shuffle(order.begin(), order.end(), mt19937(9));
+    AdaptiveHashMap map(n, 5);
+    for (int i = 0; i < n; ++i) map.insert(keys[i], values[i]);
+    vector<string> newKeys = keys, newValues = values; // rvalues, copied into the map's storage
+    size_t sink = 0;
+    cout << n << " keys, per call\n";
+    cout << "  call                   allocs       ns\n";
+    auto row = [&](const char *name, auto f) {
+        size_t before = allocationCount;
+        double t = timeMs([&] { for (int i : order) f(i); });
+        cout << "  " << left << setw(20) << name << right << fixed << setprecision(2) << setw(9)
+             << (double)(allocationCount - before) / n << setw(9) << setprecision(1) << t * 1e6 / n << "\n";
+    };
+    row("search(string)", [&](int i) { sink += map.search(keys[i]).size(); });
+    row("search(view)", [&](int i) { sink += map.search(string(views[i])).size(); });
+    row("find(view)", [&](int i) { sink += map.find(views[i])->size(); });
+    row("insert", [&](int i) { map.insert(keys[i], values[i]); });
+    row("insert_or_assign", [&](int i) { map.insert_or_assign(move(newKeys[i]), move(newValues[i])); });
+    if (sink == 42) cout << "";
+}
+
+// Resident set size in kB, from /proc (0 where that is missing)
+long rssKB() {
+    ifstream f("/proc/self/status");
+    string line;
+    while (getline(f, line))
+        if (line.compare(0, 6, "VmRSS:") == 0) return atol(line.c_str() + 6);
+    return 0;
+}
+
+// The same n path-like keys in an arena-backed and a heap-backed map: build
+// time and heap allocations per key, the map's own bytes/entry figure next
+// to the growth in resident memory, lookup time, and the time clear() takes
+// and the memory it gives back. The arena runs first so that its chunks come
+// from fresh pages, not from blocks the heap map left in malloc's free lists.
+void runArenaBenchmark(int n) {
+    vector<string> keys(n), values(n);
+    for (int i = 0; i < n; ++i) {
+        keys[i] = "/srv/data/projects/archive/file" + to_string(i) + ".txt";
+        values[i] = "/mnt/storage/volume7/blocks/" + to_string(i);
+    }
+    vector<int> order(n);
+    iota(order.begin(), order.end(), 0);
+    shuffle(order.begin(), order.end(), mt19937(11));
+    cout << n << " keys, 16 buckets to start\n";
+    cout << "  storage   build ns  allocs  bytes/entry  rss/entry  lookup ns  clear ms  rss freed MB\n";
+    for (bool useArena : {true, false}) {
+        long rss0 = rssKB();
+        AdaptiveHashMap map(16, 5, 1.0, -1, useArena);
+        size_t before = allocationCount;
+        double tBuild = timeMs([&] { for (int i = 0; i < n; ++i) map.insert(keys[i], values[i]); });
+        double allocs = (double)(allocationCount - before) / n;
+        double bytes = map.bytesPerEntry();
+        long rss1 = rssKB();
+        size_t found = 0;
+        double tLookup = timeMs([&] { for (int i : order) found += map.find(keys[i]) != nullptr; });
+        double tClear = timeMs([&] { map.clear(); });
+        long rss2 = rssKB();
+        cout << "  " << left << setw(8) << (useArena ? "arena" : "heap") << right << fixed << setprecision(1)
+             << setw(10) << tBuild * 1e6 / n << setw(8) << setprecision(2) << allocs << setw(13)
+             << setprecision(1) << bytes << setw(11) << (rss1 - rss0) * 1024.0 / n << setw(11)
+             << tLookup * 1e6 / n << setw(10) << tClear << setw(14) << (rss1 - rss2) / 1024.0
+             << (found == (size_t)n ? "" : "  WRONG") << "\n";
+    }
+}
+
+// Random inserts, updates, lookups and removes on both engines, checked
+// against std::unordered_map; few distinct keys, and one chained map that
+// never grows so its buckets become large trees. The arena-backed map is
+// cleared now and then and refilled from the reference. Returns false on
+// the first disagreement.
+bool runFuzz(int ops) {
+    mt19937 rng(17);
+    AdaptiveHashMap chained(7, 3), rehashed(5, 3, 0.5), crowded(4, 3, 1e18, 2), pooled(6, 3, 1.0, -1, true);
+    rehashed.setMigrateStep(0);
+    FlatHashMap flat(4);
+    unordered_map<string, string> ref;
+    for (int i = 0; i < ops; ++i) {
+        string key = "k" + to_string(rng() % 2000);
+        int op = rng() % 5;
+        if (op == 0) {
+            string value = to_string(rng());
+            chained.insert(key, value);
+            rehashed.insert(key, value);
+            crowded.insert(key, value);
+            pooled.insert(key, value);
+            flat.insert(key, value);
+            ref[key] = value;
+        } else if (op == 1 || op == 4) {
+            // moved-in strings; try_emplace keeps an existing value
+            string value = to_string(rng());
+            bool added = !ref.count(key);
+            bool assign = op == 1;
+            for (AdaptiveHashMap *m : {&chained, &rehashed, &crowded, &pooled}) {
+                string k = key, v = value;
+                if ((assign ? m->insert_or_assign(move(k), move(v)) : m->try_emplace(move(k), move(v))) != added) {
+                    cout << "wrong insert result at op " << i << " on " << key << "\n";
+                    return false;
+                }
+            }
+            if (assign || added) {
+                flat.insert(key, value);
+                ref[key] = value;
+            }
+        } else if (op == 2) {
+            chained.remove(key);
+            rehashed.remove(key);
+            crowded.remove(key);
+            pooled.remove(key);
+            flat.remove(key);
+            ref.erase(key);
+        }
+        auto it = ref.find(key);
+        string want = it == ref.end() ? "" : it->second;
+        if (i % 100000 == 99999) {
+            pooled.clear();
+            if (pooled.size() || pooled.memoryBytes() != pooled.bucketCount() * sizeof(Bucket)) {
+                cout << "clear left entries or arena memory at op " << i << "\n";
+                return false;
+            }
+            for (auto &kv : ref) pooled.insert(kv.first, kv.second);
+        }
+        pmr::string *view = crowded.find(string_view(key));
+        if ((view ? string(*view) : "") != want || (view != nullptr) != (it != ref.end())) {
+            cout << "find disagrees at op " << i << " on " << key << "\n";
+            return false;
+        }
+        if (chained.search(key) != want || rehashed.search(key) != want || crowded.search(key) != want ||
+            pooled.search(key) != want || flat.search(key) != want || chained.size() != ref.size() || rehashed.size() != ref.size() ||
+            crowded.size() != ref.size() || pooled.size() != ref.size() || flat.size() != ref.size()) {
+            cout << "mismatch at op " << i << " on " << key << "\n";
+            return false;
+        }
+    }
+    // 2000 keys over 4 buckets: an AVL tree of ~500 is ~11 high
+    if (crowded.maxTreeHeight() > 14) {
+        cout << "tree bucket out of balance: height " << crowded.maxTreeHeight() << "\n";
+        return false;
+    }
+    cout << "fuzz: " << ops << " operations ok\n";
+    return true;
+}
+
 // Demo
-int main() {
+int main(int argc, char **argv) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runBenchmark(argc > 2 ? atoi(argv[2]) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--growth") {
+        runGrowthBenchmark(argc > 2 ? atoi(argv[2]) : 4000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--collide") {
+        runCollisionBenchmark(argc > 2 ? atoi(argv[2]) : 20000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--lookups") {
+        runLookupBenchmark(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--arena") {
+        runArenaBenchmark(argc > 2 ? atoi(argv[2]) : 4000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--fuzz") {
+        return runFuzz(argc > 2 ? atoi(argv[2]) : 1000000) ? 0 : 1;
+    }
     AdaptiveHashMap map(50, 5);
     // Insert many keys mapping to same bucket (for demo you may craft keys that hash collide)
     map.insert("file1.txt", "/path/file1");
@@ -1,11 +1,60 @@
 #include <iostream>
+#include <algorithm>
 #include <queue>
 #include <unordered_map>
 #include <vector>
+#include <deque>
 #include <string>
 #include <ctime>
+#include <chrono>
+#include <atomic>
+#include <random>
+#include <memory>
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
 using namespace std;
 
+// Source of "minutes" timestamps. Readings must not wrap at midnight so that
+// assignedTime - admissionTime is a real wait.
+class Clock {
+public:
+    virtual ~Clock() {}
+    virtual int nowMinutes() = 0;
+};
+
+// Minutes since local midnight of the start day; the timezone lookup is done
+// once in the constructor, later readings are plain steady_clock arithmetic.
+class SystemMinutesClock : public Clock {
+private:
+    chrono::steady_clock::time_point start;
+    int startMinutes;
+
+public:
+    SystemMinutesClock() : start(chrono::steady_clock::now()) {
+        time_t t = time(nullptr);
+        tm local = *localtime(&t);
+        startMinutes = local.tm_hour * 60 + local.tm_min;
+    }
+    int nowMinutes() override {
+        auto d = chrono::steady_clock::now() - start;
+        return startMinutes + (int)chrono::duration_cast<chrono::minutes>(d).count();
+    }
+};
+
+// Driven by the caller, for deterministic runs and replaying recorded days
+class SimulatedClock : public Clock {
+private:
+    atomic<int> current;
+
+public:
+    SimulatedClock(int startMinutes = 0) : current(startMinutes) {}
+    int nowMinutes() override { return current.load(); }
+    void set(int minutes) { current.store(minutes); }
+    void advance(int minutes) { current.fetch_add(minutes); }
+};
+
 struct Patient {
     int patientID;
     string name;
@@ -15,6 +64,8 @@ struct Patient {
     int admissionTime;
     int assignedTime;
 
+    Patient() : patientID(0), severity(3), arrivalTime(0), age(0),
+                admissionTime(0), assignedTime(-1) {}
     Patient(int id, string n, int s, int aTime, int ag, int adTime)
         : patientID(id), name(n), severity(s),
           arrivalTime(aTime), age(ag),
@@ -33,54 +84,342 @@ struct ComparePatients {
     }
 };
 
+// Heap entry: the ordering fields plus a version stamp. Re-triage pushes a
+// fresh entry and bumps the patient's version, so older entries go stale and
+// are skipped when they reach the top (lazy deletion).
+struct QueueEntry {
+    int patientID;
+    int severity;
+    int arrivalTime;
+    int age;
+    unsigned version;
+};
+
+// Same ordering as ComparePatients
+struct CompareEntries {
+    bool operator()(const QueueEntry& a, const QueueEntry& b) const {
+        if (a.severity != b.severity)
+            return a.severity > b.severity;
+        else if (a.arrivalTime != b.arrivalTime)
+            return a.arrivalTime > b.arrivalTime;
+        else
+            return a.age < b.age;
+    }
+};
+
+// Bucket-queue entry: severity is implied by the bucket it sits in
+struct BucketEntry {
+    int patientID;
+    int arrivalTime;
+    int age;
+    unsigned version;
+};
+
+// Same tie-break as ComparePatients, within one severity level
+struct CompareInBucket {
+    bool operator()(const BucketEntry& a, const BucketEntry& b) const {
+        if (a.arrivalTime != b.arrivalTime)
+            return a.arrivalTime > b.arrivalTime;
+        return a.age < b.age;
+    }
+};
+
+// Assigned-patient history: fixed-size columnar segments that are allocated
+// once and never reallocated. Names are not kept, so a row is just four
+// ints. With a window set, whole segments older than it are dropped, or
+// appended to a spill file first.
+class AssignedArchive {
+public:
+    static const int SEGMENT = 4096;
+
+private:
+    struct Segment {
+        int count = 0;
+        int minAssigned = INT_MAX, maxAssigned = INT_MIN;
+        int id[SEGMENT], severity[SEGMENT], admission[SEGMENT], assigned[SEGMENT];
+    };
+    deque<unique_ptr<Segment>> segments;
+    size_t records = 0;
+    int windowMinutes = 0;  // 0 = keep everything
+    FILE* spillFile = nullptr;
+    bool spillError = false;  // a spill failed and the window was lifted
+
+    // false if the segment did not fully reach the spill file
+    bool spill(Segment& seg) {
+        bool ok = fwrite(&seg.count, sizeof(int), 1, spillFile) == 1;
+        for (int* col : {seg.id, seg.severity, seg.admission, seg.assigned})
+            ok = ok && fwrite(col, sizeof(int), seg.count, spillFile) == (size_t)seg.count;
+        return fflush(spillFile) == 0 && ok;
+    }
+
+    // Runs from append, after the patient has left the queue, so a failed
+    // spill keeps the segment in memory and is reported by spillFailed().
+    void expire(int now) {
+        while (windowMinutes > 0 && segments.size() > 1 &&
+               segments.front()->maxAssigned < now - windowMinutes) {
+            Segment& seg = *segments.front();
+            if (spillFile && !spill(seg)) {
+                // nothing more is dropped: the window is lifted instead
+                cout << "Could not write the history spill file; keeping all history in memory.\n";
+                fclose(spillFile);
+                spillFile = nullptr;
+                spillError = true;
+                windowMinutes = 0;
+                return;
+            }
+            records -= seg.count;
+            segments.pop_front();
+        }
+    }
+
+public:
+    ~AssignedArchive() {
+        if (spillFile && fclose(spillFile) != 0) cout << "Could not close the history spill file.\n";
+    }
+
+    // keep the last `minutes` of assignments (0 = all); expired segments are
+    // appended to spillPath if one is given
+    bool setWindow(int minutes, const string& spillPath = "") {
+        windowMinutes = minutes;
+        if (spillFile && fclose(spillFile) != 0) cout << "Could not close the history spill file.\n";
+        spillFile = spillPath.empty() ? nullptr : fopen(spillPath.c_str(), "ab");
+        return spillPath.empty() || spillFile;
+    }
+
+    void append(const Patient& p) {
+        if (segments.empty() || segments.back()->count == SEGMENT) {
+            expire(p.assignedTime);
+            segments.emplace_back(new Segment());
+        }
+        Segment& seg = *segments.back();
+        int i = seg.count++;
+        seg.id[i] = p.patientID;
+        seg.severity[i] = p.severity;
+        seg.admission[i] = p.admissionTime;
+        seg.assigned[i] = p.assignedTime;
+        seg.minAssigned = min(seg.minAssigned, p.assignedTime);
+        seg.maxAssigned = max(seg.maxAssigned, p.assignedTime);
+        records++;
+    }
+
+    size_t size() const { return records; }
+    bool spillFailed() const { return spillError; }
+
+    // average wait for one severity among patients assigned in [from, to];
+    // segments outside the range are skipped on their bounds alone
+    double averageWait(int severityLevel, int from = INT_MIN, int to = INT_MAX) const {
+        long long total = 0;
+        int count = 0;
+        for (auto& sp : segments) {
+            const Segment& seg = *sp;
+            if (seg.maxAssigned < from || seg.minAssigned > to) continue;
+            for (int i = 0; i < seg.count; ++i) {
+                if (seg.severity[i] == severityLevel && seg.assigned[i] >= from && seg.assigned[i] <= to) {
+                    total += seg.assigned[i] - seg.admission[i];
+                    count++;
+                }
+            }
+        }
+        return count == 0 ? 0.0 : (double)total / count;
+    }
+};
+
+// The container under a priority_queue (its protected member c), so a
+// rebuild can filter the entries where they are instead of popping them all
+template<class Q>
+typename Q::container_type& entriesOf(Q& q) {
+    struct Access : Q {
+        static typename Q::container_type Q::*member() { return &Access::c; }
+    };
+    return q.*Access::member();
+}
+
 class EmergencyRoomManager {
 private:
-    priority_queue<Patient, vector<Patient>, ComparePatients> pq;
-    unordered_map<int, Patient> allPatients;
-    vector<Patient> assignedPatients;
+    static const int NUM_SEVERITIES = 3;
+    static const int MIN_COMPACT = 1024; // never compact below this many stale entries
+
+    priority_queue<QueueEntry, vector<QueueEntry>, CompareEntries> pq;
+    unordered_map<int, Patient> allPatients; // waiting patients; assigned ones move to the archive
+    AssignedArchive assignedPatients;
+    bool lazyRetriage;  // false = old behaviour, rebuild pq on every update
+    int waiting;        // live patients in the queue
+    int stale;          // superseded entries still queued (pq, or the runs and sides)
+
+    // bucket mode: one arrival-ordered run per severity, plus a small heap
+    // for entries that arrive out of order (late arrivals, re-triage)
+    bool bucketMode;
+    Clock* clock;
+    deque<BucketEntry> runs[NUM_SEVERITIES];
+    priority_queue<BucketEntry, vector<BucketEntry>, CompareInBucket> sides[NUM_SEVERITIES];
+    unordered_map<int, unsigned> versions; // waiting patients only
+    unsigned lastVersion = 0; // versions are never reused, even by a readmitted ID
+
+    // live = the patient is still waiting and this is its latest entry
+    bool isLive(int patientID, unsigned version) {
+        auto it = versions.find(patientID);
+        return it != versions.end() && it->second == version;
+    }
+    bool isLive(const BucketEntry& e) { return isLive(e.patientID, e.version); }
+    bool isLive(const QueueEntry& e) { return isLive(e.patientID, e.version); }
+
+    void heapPush(const Patient& p) {
+        pq.push({p.patientID, p.severity, p.arrivalTime, p.age, versions[p.patientID]});
+    }
+
+    // drop every stale entry at once: filter pq's own entries and re-heapify,
+    // O(entries queued) however long the history is
+    void rebuildHeap() {
+        vector<QueueEntry>& entries = entriesOf(pq);
+        entries.erase(remove_if(entries.begin(), entries.end(),
+                                [&](const QueueEntry& e) { return !isLive(e); }),
+                      entries.end());
+        make_heap(entries.begin(), entries.end(), CompareEntries());
+        stale = 0;
+    }
+
+    // same for bucket mode: each run keeps its live entries, and the live
+    // side-heap entries are sorted and merged into it
+    void rebuildBuckets() {
+        auto before = [](const BucketEntry& a, const BucketEntry& b) { return CompareInBucket()(b, a); };
+        auto dead = [&](const BucketEntry& e) { return !isLive(e); };
+        for (int b = 0; b < NUM_SEVERITIES; ++b) {
+            vector<BucketEntry> side = move(entriesOf(sides[b]));
+            sides[b] = priority_queue<BucketEntry, vector<BucketEntry>, CompareInBucket>();
+            side.erase(remove_if(side.begin(), side.end(), dead), side.end());
+            sort(side.begin(), side.end(), before);
+            deque<BucketEntry>& run = runs[b];
+            run.erase(remove_if(run.begin(), run.end(), dead), run.end());
+            deque<BucketEntry> merged;
+            merge(run.begin(), run.end(), side.begin(), side.end(), back_inserter(merged), before);
+            run.swap(merged);
+        }
+        stale = 0;
+    }
+
+    // checked before any state changes, so a bad severity leaves nothing behind
+    static bool validSeverity(int severity) {
+        if (severity >= 1 && severity <= NUM_SEVERITIES) return true;
+        cout << "Severity must be 1, 2 or 3.\n";
+        return false;
+    }
+
+    void bucketPush(const Patient& p) {
+        BucketEntry e = {p.patientID, p.arrivalTime, p.age, versions[p.patientID]};
+        deque<BucketEntry>& run = runs[p.severity - 1];
+        if (run.empty() || !CompareInBucket()(run.back(), e))
+            run.push_back(e);
+        else
+            sides[p.severity - 1].push(e);
+    }
+
+    // pops the highest-priority live entry; returns its patientID or -1
+    int bucketPop() {
+        for (int b = 0; b < NUM_SEVERITIES; ++b) {
+            deque<BucketEntry>& run = runs[b];
+            auto& side = sides[b];
+            while (!run.empty() && !isLive(run.front())) {
+                run.pop_front();
+                stale--;
+            }
+            while (!side.empty() && !isLive(side.top())) {
+                side.pop();
+                stale--;
+            }
+            if (run.empty() && side.empty()) continue;
+            int id;
+            if (!side.empty() && (run.empty() || CompareInBucket()(run.front(), side.top()))) {
+                id = side.top().patientID;
+                side.pop();
+            } else {
+                id = run.front().patientID;
+                run.pop_front();
+            }
+            return id;
+        }
+        return -1;
+    }
 
 public:
+    // useBuckets selects the O(1) severity bucket queue instead of the heap;
+    // clk defaults to a process-wide SystemMinutesClock
+    EmergencyRoomManager(bool useBuckets = false, Clock* clk = nullptr)
+        : lazyRetriage(true), waiting(0), stale(0), bucketMode(useBuckets), clock(clk) {
+        static SystemMinutesClock systemClock;
+        if (!clock) clock = &systemClock;
+    }
+
+    // Heap mode only: turn lazy re-triage off to get the old full rebuild
+    void setLazyRetriage(bool lazy) { lazyRetriage = lazy; }
+
     // Admit new patient
     void admitPatient(const Patient& p) {
-        pq.push(p);
+        if (!validSeverity(p.severity)) return;
         allPatients[p.patientID] = p;
+        versions[p.patientID] = ++lastVersion;
+        waiting++;
+        if (bucketMode) bucketPush(p);
+        else heapPush(p);
     }
 
     // Update severity
     void updatePatientCondition(int patientID, int newSeverity) {
         if (allPatients.find(patientID) == allPatients.end()) {
-            cout << "Patient not found.\n";
+            cout << "Patient not found or already assigned.\n";
             return;
         }
         Patient updated = allPatients[patientID];
-        if (updated.assignedTime != -1) {
-            cout << "Cannot update condition. Patient already assigned.\n";
-            return;
-        }
+        if (!validSeverity(newSeverity)) return;
         updated.severity = newSeverity;
         allPatients[patientID] = updated;
 
-        // rebuild queue (simple way for now)
-        priority_queue<Patient, vector<Patient>, ComparePatients> newPQ;
-        for (auto& p : allPatients) {
-            if (p.second.assignedTime == -1)
-                newPQ.push(p.second);
+        // old entry goes stale, the new one is pushed alongside it
+        versions[patientID] = ++lastVersion;
+        if (bucketMode) {
+            bucketPush(updated);
+            stale++;
+            if (stale > MIN_COMPACT && stale > waiting)
+                rebuildBuckets();
+            return;
+        }
+        heapPush(updated);
+        if (!lazyRetriage) {
+            rebuildHeap();
+            return;
         }
-        pq = move(newPQ);
+        stale++;
+        if (stale > MIN_COMPACT && stale > waiting)
+            rebuildHeap();
     }
 
     // Assign doctors to top priority patients
     int assignDoctors(int availableDoctors) {
         int count = 0;
-        int currentTime = time(nullptr) % 100000; // simple timestamp substitute
+        int currentTime = clock->nowMinutes();
 
-        while (!pq.empty() && availableDoctors > 0) {
-            Patient top = pq.top();
-            pq.pop();
+        while (availableDoctors > 0) {
+            Patient top;
+            if (bucketMode) {
+                int id = bucketPop();
+                if (id == -1) break;
+                top = move(allPatients[id]);
+            } else {
+                while (!pq.empty() && !isLive(pq.top())) {
+                    pq.pop();
+                    stale--;
+                }
+                if (pq.empty()) break;
+                top = move(allPatients[pq.top().patientID]);
+                pq.pop();
+            }
 
-            allPatients[top.patientID].assignedTime = currentTime;
-            assignedPatients.push_back(allPatients[top.patientID]);
+            // the archive row is all that is kept of an assigned patient
+            top.assignedTime = currentTime;
+            assignedPatients.append(top);
+            allPatients.erase(top.patientID);
+            versions.erase(top.patientID);
 
+            waiting--;
             availableDoctors--;
             count++;
         }
@@ -89,21 +428,27 @@ public:
 
     // Compute average waiting time for a given severity
     double getAverageWaitingTime(int severityLevel) {
-        int total = 0, count = 0;
-        for (auto& p : assignedPatients) {
-            if (p.severity == severityLevel) {
-                int wait = p.assignedTime - p.admissionTime;
-                total += wait;
-                count++;
-            }
-        }
-        if (count == 0) return 0.0;
-        return (double)total / count;
+        return assignedPatients.averageWait(severityLevel);
     }
 
+    // Same, over patients assigned in the last `minutes` only
+    double getRecentWaitingTime(int severityLevel, int minutes) {
+        int now = clock->nowMinutes();
+        return assignedPatients.averageWait(severityLevel, now - minutes, now);
+    }
+
+    // Bound the history to the last `minutes` (0 = unbounded); older
+    // records are dropped, or appended to spillPath if given
+    bool setHistoryWindow(int minutes, const string& spillPath = "") {
+        return assignedPatients.setWindow(minutes, spillPath);
+    }
+    bool historySpillFailed() const { return assignedPatients.spillFailed(); }
+
     // For testing/debugging
     void displayQueue() {
-        priority_queue<Patient, vector<Patient>, ComparePatients> temp = pq;
+        priority_queue<Patient, vector<Patient>, ComparePatients> temp;
+        for (auto& p : allPatients)
+            if (p.second.assignedTime == -1) temp.push(p.second);
         cout << "\nCurrent waiting patients:\n";
         while (!temp.empty()) {
             Patient p = temp.top();
@@ -116,11 +461,96 @@ public:
     }
 };
 
+// ----------------------
+// Benchmark: lazy re-triage vs full rebuild (run with --bench [n])
+// ----------------------
+double retriageBenchmark(int n, bool lazy, int updates, long long& check) {
+    SimulatedClock clock(0);
+    EmergencyRoomManager er(false, &clock);
+    er.setLazyRetriage(lazy);
+    mt19937 rng(42);
+    for (int i = 0; i < n; ++i)
+        er.admitPatient(Patient(i, "P" + to_string(i), 1 + rng() % 3, rng() % 1440, rng() % 100, 0));
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < updates; ++i)
+        er.updatePatientCondition(rng() % n, 1 + rng() % 3);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    check = (long long)(er.assignDoctors(n)); // drains through any stale entries
+    return ms;
+}
+
+void runRetriageBenchmark(int n) {
+    int updates = n / 10;
+    // a rebuild per update is O(n log n); time a sample and scale it up
+    int sample = min(updates, 200);
+    long long c1, c2;
+    double lazy = retriageBenchmark(n, true, updates, c1);
+    double rebuild = retriageBenchmark(n, false, sample, c2) * updates / sample;
+    cout << n << " waiting, " << updates << " re-triages\n";
+    cout << "  rebuild per update: " << rebuild << " ms (extrapolated from " << sample << ")\n";
+    cout << "  lazy invalidation:  " << lazy << " ms (" << rebuild / lazy << "x faster)\n";
+    cout << "  all patients assigned: " << (c1 == n && c2 == n ? "yes" : "NO") << "\n";
+}
+
+// ----------------------
+// Soak check: footprint over a long run with a history window (run with
+// --soak [days])
+// ----------------------
+// Resident set size in kB, from /proc (0 where that is missing)
+long rssKB() {
+    ifstream f("/proc/self/status");
+    string line;
+    while (getline(f, line))
+        if (line.compare(0, 6, "VmRSS:") == 0) return atol(line.c_str() + 6);
+    return 0;
+}
+
+// 20 patients a minute with unique names, re-triaged now and then and
+// assigned as fast as they come, under a 24h window. Once the first window
+// has filled, memory must stop growing.
+bool runSoak(int days) {
+    SimulatedClock clock(0);
+    EmergencyRoomManager er(false, &clock);
+    er.setHistoryWindow(24 * 60);
+    mt19937 rng(7);
+    int id = 0;
+    long settled = 0, peak = 0;
+    cout << "day   RSS MB\n";
+    for (int day = 1; day <= days; ++day) {
+        for (int minute = 0; minute < 24 * 60; ++minute) {
+            for (int i = 0; i < 20; ++i, ++id)
+                er.admitPatient(Patient(id, "Soak Test Patient Number " + to_string(id), 1 + rng() % 3,
+                                        clock.nowMinutes(), rng() % 100, clock.nowMinutes()));
+            for (int i = 0; i < 5; ++i) er.updatePatientCondition(id - 1 - rng() % 20, 1 + rng() % 3);
+            er.assignDoctors(20);
+            clock.advance(1);
+        }
+        long rss = rssKB();
+        if (day == 2) settled = rss;
+        if (day > 2) peak = max(peak, rss);
+        cout << setw(3) << day << setw(9) << fixed << setprecision(1) << rss / 1024.0 << "\n";
+    }
+    // allow for allocator noise on top of the settled footprint
+    bool flat = days <= 2 || peak <= settled + settled / 10 + 1024;
+    cout << "footprint flat after the first window: " << (flat ? "yes" : "NO") << "\n";
+    return flat;
+}
+
 // ----------------------
 // Example usage
 // ----------------------
-int main() {
-    EmergencyRoomManager er;
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runRetriageBenchmark(argc > 2 ? atoi(argv[2]) : 100000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--soak") {
+        return runSoak(argc > 2 ? atoi(argv[2]) : 14) ? 0 : 1;
+    }
+    bool buckets = argc > 1 && string(argv[1]) == "--buckets";
+    // demo times are minutes since midnight, so drive the clock explicitly
+    SimulatedClock clock(100);
+    EmergencyRoomManager er(buckets, &clock);
 
     er.admitPatient(Patient(1, "Alice", 2, 100, 70, 100));
     er.admitPatient(Patient(2, "Bob", 1, 110, 40, 110));
@@ -129,6 +559,7 @@ int main() {
     cout << "Before assignment:";
     er.displayQueue();
 
+    clock.set(130);
     er.assignDoctors(2);
 
     cout << "\nAverage waiting time (Urgent): " << er.getAverageWaitingTime(2) << endl;